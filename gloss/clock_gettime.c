@@ -0,0 +1,48 @@
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <metal/timer.h>
+
+#ifndef CLOCK_REALTIME
+#define CLOCK_REALTIME (clockid_t)1
+#endif
+#ifndef CLOCK_MONOTONIC
+#define CLOCK_MONOTONIC (clockid_t)4
+#endif
+
+/* Both clocks count mtime from reset, there's no battery-backed clock to
+ * give the real time of day. */
+int
+clock_gettime(clockid_t clock_id, struct timespec *tp)
+{
+  unsigned long long rem;
+
+  if (clock_id != CLOCK_MONOTONIC && clock_id != CLOCK_REALTIME) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  tp->tv_sec = metal_timer_ticks_to_sec(metal_mtime_read(), &rem);
+  tp->tv_nsec = metal_timer_ticks_to_ns(rem);
+  return 0;
+}
+
+int
+clock_getres(clockid_t clock_id, struct timespec *res)
+{
+  if (clock_id != CLOCK_MONOTONIC && clock_id != CLOCK_REALTIME) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (res) {
+    /* One mtime tick */
+    unsigned long long ns = metal_timer_ticks_to_ns(1);
+    if (ns == 0) {
+      ns = 1;
+    }
+    res->tv_sec = ns / 1000000000ULL;
+    res->tv_nsec = ns % 1000000000ULL;
+  }
+  return 0;
+}
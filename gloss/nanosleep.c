@@ -1,9 +1,122 @@
 #include <errno.h>
+#include <limits.h>
+#include <time.h>
 #include <sys/time.h>
+#include <metal/drivers/riscv_cpu.h>
+#include <metal/idle.h>
+#include <metal/timer.h>
+
+#ifndef CLOCK_REALTIME
+#define CLOCK_REALTIME (clockid_t)1
+#endif
+#ifndef CLOCK_MONOTONIC
+#define CLOCK_MONOTONIC (clockid_t)4
+#endif
+#ifndef TIMER_ABSTIME
+#define TIMER_ABSTIME 4
+#endif
+
+/* Delays shorter than this aren't worth the cost of programming mtimecmp and
+ * waking up from wfi, so they spin on mtime instead. */
+#ifndef METAL_NANOSLEEP_SPIN_NS
+#define METAL_NANOSLEEP_SPIN_NS 20000
+#endif
+
+static void
+sleep_until(unsigned long long deadline)
+{
+  unsigned long long spin = metal_timer_ns_to_ticks(METAL_NANOSLEEP_SPIN_NS);
+  unsigned long long now;
+  unsigned long mie;
+
+  __asm__ volatile("csrr %0, mie" : "=r"(mie));
+
+  while ((now = metal_mtime_read()) < deadline) {
+    unsigned long mstatus;
+
+    if (deadline - now <= spin) {
+      continue;
+    }
+
+    if (mie & METAL_LOCAL_INTERRUPT_TMR) {
+      /* Someone else owns the timer interrupt.  If it's the software timer
+       * wheel, sleep on that, otherwise all we can do is spin. */
+      if (metal_idle_until(deadline) != 0) {
+        spin = ULLONG_MAX;
+      }
+      continue;
+    }
+
+    /* Nobody else is using mtimecmp, so borrow it.  With interrupts
+     * disabled the timer interrupt only ends the wfi and is never taken. */
+    mstatus = __metal_irq_save();
+    if (metal_timer_set_compare(deadline) != 0) {
+      /* The timer isn't set up, so it would never wake us */
+      spin = ULLONG_MAX;
+    } else {
+      __asm__ volatile("csrs mie, %0" :: "r"(METAL_LOCAL_INTERRUPT_TMR));
+      __asm__ volatile("wfi");
+      __asm__ volatile("csrc mie, %0" :: "r"(METAL_LOCAL_INTERRUPT_TMR));
+      metal_timer_set_compare(ULLONG_MAX);
+    }
+
+    /* Take whatever other interrupt woke us up, then go back to sleep */
+    __metal_irq_restore(mstatus);
+  }
+}
+
+static unsigned long long
+timespec_to_ticks(const struct timespec *ts)
+{
+  /* Saturate rather than wrap, so a very long sleep doesn't end at once */
+  if ((unsigned long long)ts->tv_sec >= ULLONG_MAX / 1000000000ULL) {
+    return ULLONG_MAX;
+  }
+  return metal_timer_ns_to_ticks((unsigned long long)ts->tv_sec * 1000000000ULL
+                                 + ts->tv_nsec);
+}
+
+int
+clock_nanosleep(clockid_t clock_id, int flags, const struct timespec *rqtp,
+                struct timespec *rmtp)
+{
+  unsigned long long deadline, now;
+
+  if (clock_id != CLOCK_MONOTONIC && clock_id != CLOCK_REALTIME) {
+    return EINVAL;
+  }
+  if (rqtp->tv_sec < 0 || rqtp->tv_nsec < 0 || rqtp->tv_nsec >= 1000000000L) {
+    return EINVAL;
+  }
+
+  if (flags & TIMER_ABSTIME) {
+    deadline = timespec_to_ticks(rqtp);
+  } else {
+    now = metal_mtime_read();
+    deadline = now + timespec_to_ticks(rqtp);
+    if (deadline < now) {
+      deadline = ULLONG_MAX;
+    }
+  }
+
+  sleep_until(deadline);
+
+  /* There are no signals, so the sleep is never cut short */
+  if (rmtp && !(flags & TIMER_ABSTIME)) {
+    rmtp->tv_sec = 0;
+    rmtp->tv_nsec = 0;
+  }
+  return 0;
+}
 
 int
 nanosleep(const struct timespec *rqtp, struct timespec *rmtp)
 {
-  errno = ENOSYS;
-  return -1;
+  int rv = clock_nanosleep(CLOCK_MONOTONIC, 0, rqtp, rmtp);
+
+  if (rv != 0) {
+    errno = rv;
+    return -1;
+  }
+  return 0;
 }
@@ -5,17 +5,12 @@
 int
 _gettimeofday(struct timeval *tp, void *tzp)
 {
-    int rv;
-    unsigned long long mcc, timebase;
-    rv = metal_timer_get_cyclecount(0, &mcc);
-    if (rv != 0) {
-        return -1;
-    }
-    rv = metal_timer_get_timebase_frequency(0, &timebase);
-    if (rv != 0) {
+    unsigned long long rem;
+
+    if (__metal_mtime_check()) {
         return -1;
     }
-    tp->tv_sec = mcc / timebase;
-    tp->tv_usec = mcc % timebase * 1000000 / timebase;
+    tp->tv_sec = metal_timer_ticks_to_sec(metal_mtime_read(), &rem);
+    tp->tv_usec = metal_timer_ticks_to_us(rem);
     return 0;
 }
@@ -3,8 +3,6 @@
 #include <metal/timer.h>
 #include <errno.h>
 
-extern int _gettimeofday(struct timeval *, void *);
-
 /* Timing information for current process. From
    newlib/libc/include/sys/times.h the tms struct fields are as follows:
 
@@ -16,27 +14,27 @@ extern int _gettimeofday(struct timeval *, void *);
    Since maven does not currently support processes we set both of the
    children's times to zero. Eventually we might want to separately
    account for user vs system time, but for now we just return the total
-   number of cycles since starting the program.  */
+   number of mtime ticks since starting the program.  */
 clock_t
 _times(struct tms *buf)
 {
-    int rv;
     // when called for the first time, initialize t0
-    static struct timeval t0;
-    if (t0.tv_sec == 0 && t0.tv_usec == 0)
-        _gettimeofday (&t0, 0);
-
-    struct timeval t;
-    _gettimeofday (&t, 0);
+    static unsigned long long t0;
+    static int started;
+    unsigned long long t;
 
-    unsigned long long timebase;
-    rv = metal_timer_get_timebase_frequency(0, &timebase);
-    if (rv != 0) {
+    if (__metal_mtime_check()) {
         return -1;
     }
 
-    long long utime = (t.tv_sec - t0.tv_sec) * 1000000 + (t.tv_usec - t0.tv_usec);
-    buf->tms_utime = utime * timebase / 1000000;
+    t = metal_mtime_read();
+    if (!started) {
+        t0 = t;
+        started = 1;
+    }
+
+    /* mtime is already in timebase ticks, so there's nothing to convert */
+    buf->tms_utime = t - t0;
     buf->tms_stime = buf->tms_cstime = buf->tms_cutime = 0;
     return 0;
 }
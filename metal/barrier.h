@@ -0,0 +1,133 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef METAL__BARRIER_H
+#define METAL__BARRIER_H
+
+#include <metal/machine.h>
+#include <metal/memory.h>
+#include <metal/compiler.h>
+#include <metal/io.h>
+#include <metal/lock.h>
+
+#ifdef __ICCRISCV__
+#define __asm__ asm
+#endif
+/*!
+ * @file barrier.h
+ * @brief An API for synchronizing a group of harts at run time
+ *
+ * A barrier is a sense-reversing counter shared by a fixed number of harts.
+ * It can be used any number of times and does not use interrupts, so it is
+ * cheap enough to separate the phases of a parallel computation.
+ */
+
+/*!
+ * @def METAL_BARRIER_DECLARE
+ * @brief Declare a barrier
+ *
+ * Barriers must be declared with METAL_BARRIER_DECLARE to ensure that the
+ * barrier is linked into a memory region which supports atomic memory
+ * operations.
+ */
+#define METAL_BARRIER_DECLARE(name) \
+		__attribute__((section(".data.locks"))) \
+		struct metal_barrier name
+
+/*!
+ * @brief A handle for a barrier
+ */
+struct metal_barrier {
+	/* The number of harts which have arrived in the current episode */
+	int _count __attribute__((aligned(64)));
+	/* Flipped by the last hart to arrive, released harts spin on it */
+	int _sense __attribute__((aligned(64)));
+	int _harts;
+};
+
+/*!
+ * @brief Initialize a barrier
+ * @param barrier The handle for a barrier
+ * @param harts The number of harts which will wait on the barrier
+ * @return 0 if the barrier is successfully initialized. A non-zero code indicates failure.
+ *
+ * The barrier must be initialized before any hart waits on it. If the barrier
+ * cannot be initialized, attempts to wait on it will result in a Store/AMO
+ * access fault.
+ */
+__inline__ int metal_barrier_init(struct metal_barrier *barrier, int harts) {
+#ifdef __riscv_atomic
+    /* Get a handle for the memory which holds the barrier state */
+    struct metal_memory *barrier_mem = metal_get_memory_from_address((uintptr_t) &(barrier->_count));
+    if(!barrier_mem) {
+        return 1;
+    }
+
+    /* If the memory doesn't support atomics, report an error */
+    if(!metal_memory_supports_atomics(barrier_mem)) {
+        return 2;
+    }
+
+    if(harts < 1) {
+        return 4;
+    }
+
+    barrier->_count = 0;
+    barrier->_sense = 0;
+    barrier->_harts = harts;
+
+    __asm__ volatile("fence w,rw" ::: "memory");
+
+    return 0;
+#else
+    return 3;
+#endif
+}
+
+/*!
+ * @brief Wait until all harts have reached a barrier
+ * @param barrier The handle for a barrier
+ * @return 1 on exactly one of the harts, 0 on the others
+ *
+ * Blocks the calling hart until the number of harts given to
+ * metal_barrier_init() have called metal_barrier_wait(). Memory accesses made
+ * before the barrier by any participating hart are visible to all of them
+ * after it. The barrier is immediately ready for the next use.
+ */
+__inline__ int metal_barrier_wait(struct metal_barrier *barrier) {
+#ifdef __riscv_atomic
+    int sense = __METAL_ACCESS_ONCE(&(barrier->_sense));
+    int arrived;
+
+    __asm__ volatile("amoadd.w.aqrl %[arrived], %[one], (%[count])"
+                     : [arrived] "=r" (arrived)
+                     : [one] "r" (1), [count] "r" (&(barrier->_count))
+                     : "memory");
+
+    if (arrived == barrier->_harts - 1) {
+        /* Last to arrive: reset the count for the next episode, then
+         * release everyone else */
+        __METAL_ACCESS_ONCE(&(barrier->_count)) = 0;
+        __asm__ volatile("fence rw,w" ::: "memory");
+        __METAL_ACCESS_ONCE(&(barrier->_sense)) = !sense;
+        return 1;
+    }
+
+    while (__METAL_ACCESS_ONCE(&(barrier->_sense)) == sense) ;
+    __asm__ volatile("fence r,rw" ::: "memory");
+
+    return 0;
+#else
+    /* Store the memory address in mtval like a normal store/amo access fault */
+    __asm__ ("csrw mtval, %[count]"
+             :: [count] "r" (&(barrier->_count)));
+
+    /* Trigger a Store/AMO access fault */
+    _metal_trap(_METAL_STORE_AMO_ACCESS_FAULT);
+
+    /* If execution returns, indicate failure */
+    return -1;
+#endif
+}
+
+#endif /* METAL__BARRIER_H */
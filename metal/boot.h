@@ -0,0 +1,145 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef METAL__BOOT_H
+#define METAL__BOOT_H
+
+/*!
+ * @file boot.h
+ * @brief API for measuring boot time
+ *
+ * _enter notes the value of mcycle before doing anything else and passes it to
+ * _start in a3, and the Freedom Metal crt0 saves it once memory is
+ * initialized. Calling
+ * metal_boot_cycles() first thing in main() gives the number of cycles spent
+ * copying .data, zeroing .bss and running constructors.
+ *
+ * Normally the boot hart initializes memory alone while the other harts wait.
+ * A program which uses METAL_BOOT_PARALLEL instead has every hart copy and
+ * zero its own slice of .data, .itim, .bss and the DTIM sections, after which
+ * they wait for each other and the boot hart goes on to run the constructors.
+ * Slices are split by hart ID, so this assumes harts 0 to
+ * __METAL_DT_MAX_HARTS - 1 all boot.
+ */
+
+/*!
+ * @def METAL_BOOT_PARALLEL
+ * @brief Initialize memory on every hart at boot
+ *
+ * Use once at file scope in any source file of the program. Linking with
+ * -Wl,-u,__metal_boot_parallel has the same effect.
+ */
+#define METAL_BOOT_PARALLEL \
+		extern void __metal_boot_parallel(int hartid); \
+		static void (*const _metal_boot_parallel_ref)(int) \
+			__attribute__((used)) = __metal_boot_parallel
+
+/*!
+ * @def METAL_BOOT_DATA_COMPRESSED
+ * @brief Let crt0 decompress the load image of .data
+ *
+ * Use once at file scope in any source file of the program, then run
+ * scripts/compress-data on the linked program to replace the image with an
+ * LZ4 compressed copy. crt0 decompresses it into RAM at boot, and still copies
+ * an image which wasn't compressed.
+ *
+ * The image shrinks in place, so the flash saved is only recovered in a
+ * binary image if .data is the last thing the linker script loads into
+ * flash. Hex and ELF images skip the gap wherever it is.
+ */
+#define METAL_BOOT_DATA_COMPRESSED \
+		extern int __metal_boot_data_compressed(void); \
+		static int (*const _metal_boot_data_ref)(void) \
+			__attribute__((used)) = __metal_boot_data_compressed
+
+/*!
+ * @def METAL_BOOT_PROFILE_MAX_CONSTRUCTORS
+ * @brief The maximum number of constructors the boot profiler times
+ */
+#ifndef METAL_BOOT_PROFILE_MAX_CONSTRUCTORS
+#define METAL_BOOT_PROFILE_MAX_CONSTRUCTORS 32
+#endif
+
+/*!
+ * @def METAL_BOOT_PROFILE
+ * @brief Record where the boot time goes
+ *
+ * Use once at file scope in any source file of the program. crt0 then notes
+ * mcycle at each phase of the boot in metal_boot_profile, and runs the
+ * constructors one at a time to time each of them, which covers drivers set up
+ * by constructors like the PLL, the caches and the TTY.
+ */
+#define METAL_BOOT_PROFILE \
+		extern void __metal_boot_profile_init_array(void); \
+		static void (*const _metal_boot_profile_ref)(void) \
+			__attribute__((used)) = __metal_boot_profile_init_array
+
+/*!
+ * @brief The time taken by one constructor
+ */
+struct metal_boot_profile_constructor {
+	/*! The constructor */
+	void (*fn)(void);
+	/*! The cycles it took */
+	unsigned long cycles;
+};
+
+/*!
+ * @brief The values of mcycle at each phase of the boot
+ *
+ * Filled in on the boot hart when the program uses METAL_BOOT_PROFILE.
+ * Values are kept to the width of a register, so differences between them
+ * are right as long as the boot takes less than 2^XLEN cycles.
+ */
+struct metal_boot_profile {
+	/*! When _enter started running */
+	unsigned long enter;
+	/*! When crt0 started copying .data and the TIM sections */
+	unsigned long copy_start;
+	/*! When crt0 finished copying and started zeroing .bss */
+	unsigned long zero_start;
+	/*! When crt0 finished zeroing */
+	unsigned long zero_end;
+	/*! When the constructors started running */
+	unsigned long constructors_start;
+	/*! When the constructors finished */
+	unsigned long constructors_end;
+	/*! When main() was about to be called */
+	unsigned long main;
+	/*! The number of constructors which ran */
+	unsigned int constructor_count;
+	/*! The first METAL_BOOT_PROFILE_MAX_CONSTRUCTORS of them, in the order
+	 * they ran */
+	struct metal_boot_profile_constructor
+		constructors[METAL_BOOT_PROFILE_MAX_CONSTRUCTORS];
+};
+
+/*!
+ * @brief The boot profile
+ *
+ * Can be read with a debugger as well as from the program.
+ */
+extern struct metal_boot_profile metal_boot_profile;
+
+/*!
+ * @brief Print the boot profile to the TTY
+ *
+ * Prints the cycles spent in each phase, then in each constructor by
+ * address. Calling it links in the profiler, like METAL_BOOT_PROFILE.
+ */
+void metal_boot_profile_dump(void);
+
+/*!
+ * @brief Get the number of cycles since _enter started running
+ * @return The cycles elapsed on the boot hart, or since reset if the C
+ * runtime didn't record the start
+ *
+ * If _start was called by something other than _enter, a3 holds no start
+ * time. crt0 can only tell when it is later than the current cycle count, in
+ * which case it counts from reset instead; otherwise the result counts from
+ * whatever a3 held. Only meaningful on the boot hart. The count is kept to the width of a
+ * register, so on RV32 it wraps after 2^32 cycles.
+ */
+unsigned long metal_boot_cycles(void);
+
+#endif
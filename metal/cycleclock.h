@@ -0,0 +1,83 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef METAL__CYCLECLOCK_H
+#define METAL__CYCLECLOCK_H
+
+#include <metal/clock.h>
+
+/*!
+ * @file cycleclock.h
+ * @brief API for a high resolution per-hart clock calibrated against mtime
+ *
+ * mtime is shared by all harts and runs at a fixed rate, but often much
+ * slower than the core. mcycle counts every core clock, but is private to
+ * each hart and changes rate with the core clock. The cycle clock measures
+ * each hart's mcycle rate against mtime, then tells the time from mcycle
+ * alone, re-anchoring to mtime periodically so it keeps mtime's accuracy.
+ *
+ * Every hart calibrates during boot, before main() is called, so reading the
+ * clock never busy-waits. Registering the core clock with
+ * metal_cycleclock_track() recalibrates after a rate change.
+ */
+
+/*!
+ * @def METAL_CYCLECLOCK_CALIBRATION_TICKS
+ * @brief The number of mtime ticks to measure mcycle over when calibrating
+ */
+#ifndef METAL_CYCLECLOCK_CALIBRATION_TICKS
+#define METAL_CYCLECLOCK_CALIBRATION_TICKS 64
+#endif
+
+/*!
+ * @def METAL_CYCLECLOCK_RESYNC_TICKS
+ * @brief The number of mtime ticks between re-anchoring to mtime
+ *
+ * Each re-anchor also refines the measured mcycle rate.
+ */
+#ifndef METAL_CYCLECLOCK_RESYNC_TICKS
+#define METAL_CYCLECLOCK_RESYNC_TICKS 4096
+#endif
+
+/*!
+ * @def METAL_CYCLECLOCK_MAX_CLOCKS
+ * @brief The maximum number of clocks which can be tracked
+ */
+#ifndef METAL_CYCLECLOCK_MAX_CLOCKS
+#define METAL_CYCLECLOCK_MAX_CLOCKS 2
+#endif
+
+/*!
+ * @brief Calibrate the current hart's cycle clock
+ * @return 0 upon success
+ *
+ * Busy-waits for METAL_CYCLECLOCK_CALIBRATION_TICKS ticks of mtime.
+ */
+int metal_cycleclock_calibrate(void);
+
+/*!
+ * @brief Recalibrate all harts when a clock changes rate
+ * @param clk The clock which drives the harts' cores
+ * @return 0 upon success, or -1 if too many clocks are tracked
+ *
+ * The hart which changes the rate measures the new rate. Every other hart
+ * adopts that measurement the next time it reads its cycle clock.
+ */
+int metal_cycleclock_track(struct metal_clock *clk);
+
+/*!
+ * @brief Read the current hart's cycle clock
+ * @return The time since reset in nanoseconds
+ *
+ * The value never goes backwards on a hart. Values from different harts agree
+ * to within the mtime resolution.
+ */
+unsigned long long metal_cycleclock_ns(void);
+
+/*!
+ * @brief Get the measured core clock rate of the current hart
+ * @return The mcycle rate in Hz
+ */
+unsigned long long metal_cycleclock_get_rate_hz(void);
+
+#endif /* METAL__CYCLECLOCK_H */
@@ -158,6 +158,51 @@ typedef struct __metal_interrupt_data {
 
 uintptr_t __metal_myhart_id(void);
 
+/* Get the ID of the current hart from mhartid, without a call */
+__inline__ int __metal_current_hartid(void)
+{
+    int hartid;
+    __asm__ volatile("csrr %0, mhartid" : "=r" (hartid));
+    return hartid;
+}
+
+/* Disable machine interrupts on the current hart, returning the old mstatus
+ * for __metal_irq_restore() */
+__inline__ unsigned long __metal_irq_save(void)
+{
+    unsigned long mstatus;
+    __asm__ volatile("csrrc %0, mstatus, %1"
+                     : "=r" (mstatus) : "r" (METAL_MSTATUS_MIE) : "memory");
+    return mstatus;
+}
+
+/* Re-enable machine interrupts if they were enabled before __metal_irq_save() */
+__inline__ void __metal_irq_restore(unsigned long mstatus)
+{
+    __asm__ volatile("csrs mstatus, %0"
+                     :: "r" (mstatus & METAL_MSTATUS_MIE) : "memory");
+}
+
+/* Read the whole of mcycle, which takes three reads on RV32 */
+__inline__ unsigned long long __metal_mcycle_read(void)
+{
+#if __riscv_xlen == 32
+    unsigned long hi, hi1, lo;
+
+    do {
+        __asm__ volatile("csrr %0, mcycleh" : "=r" (hi));
+        __asm__ volatile("csrr %0, mcycle" : "=r" (lo));
+        __asm__ volatile("csrr %0, mcycleh" : "=r" (hi1));
+    } while (hi != hi1);
+
+    return ((unsigned long long)hi << 32) | lo;
+#else
+    unsigned long long val;
+    __asm__ volatile("csrr %0, mcycle" : "=r" (val));
+    return val;
+#endif
+}
+
 struct __metal_driver_vtable_riscv_cpu_intc {
   struct metal_interrupt_vtable controller_vtable;
 };
@@ -167,6 +212,8 @@ void __metal_interrupt_global_enable(void);
 void __metal_interrupt_global_disable(void);
 metal_vector_mode __metal_controller_interrupt_vector_mode(void);
 void __metal_controller_interrupt_vector(metal_vector_mode mode, void *vec_table);
+/* Handle the current trap, for trap entries which save the context themselves */
+void __metal_exception_dispatch(void);
 
 __METAL_DECLARE_VTABLE(__metal_driver_vtable_riscv_cpu_intc)
 
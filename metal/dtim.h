@@ -0,0 +1,55 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef METAL__DTIM_H
+#define METAL__DTIM_H
+
+/*! @file dtim.h
+ *
+ * API for placing data in the DTIM
+ *
+ * The DTIM (Data Tightly Integrated Memory) has no wait states, which makes
+ * it a good home for hot data like ring buffers, lock words and filter state.
+ *
+ * The linker script places these sections in the DTIM, if the target device
+ * has one, and provides the following symbols, each aligned to a word:
+ *
+ * - metal_segment_dtim_source_start, metal_segment_dtim_target_start and
+ *   metal_segment_dtim_target_end bound .data.dtim and its load image.
+ * - metal_segment_dtim_bss_target_start and metal_segment_dtim_bss_target_end
+ *   bound .bss.dtim.
+ * - metal_segment_dtim_noinit_target_start and
+ *   metal_segment_dtim_noinit_target_end bound .noinit.dtim.
+ *
+ * The Freedom Metal crt0 copies and zeroes the sections like .data and .bss.
+ * The section names give them the right types, so a linker script which
+ * doesn't know about the DTIM links .data.dtim and .bss.dtim with the rest of
+ * .data and .bss, where they are still initialized.
+ *
+ * scripts/tim-usage reports how much of the ITIM and DTIM a linked program
+ * uses, and can fail the build when either overflows.
+ */
+
+/*! @def METAL_PLACE_IN_DTIM
+ * @brief Link an initialized variable into the DTIM
+ *
+ * The initial value is copied into the DTIM at boot.
+ */
+#define METAL_PLACE_IN_DTIM	__attribute__((section(".data.dtim")))
+
+/*! @def METAL_PLACE_IN_DTIM_ZERO
+ * @brief Link a zero-initialized variable into the DTIM
+ *
+ * The variable takes no space in the load image, and is zeroed at boot.
+ */
+#define METAL_PLACE_IN_DTIM_ZERO	__attribute__((section(".bss.dtim")))
+
+/*! @def METAL_PLACE_IN_DTIM_NOINIT
+ * @brief Link an uninitialized variable into the DTIM
+ *
+ * The variable is left alone at boot, so it keeps its contents across a
+ * reset which doesn't clear the DTIM and costs nothing to start up.
+ */
+#define METAL_PLACE_IN_DTIM_NOINIT	__attribute__((section(".noinit.dtim")))
+
+#endif
@@ -0,0 +1,83 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef METAL__HART_LOCAL_H
+#define METAL__HART_LOCAL_H
+
+#include <stdint.h>
+
+/*!
+ * @file hart_local.h
+ * @brief API for variables with a separate copy on every hart
+ *
+ * Hart-local variables are thread-local variables in the metal_hart_local
+ * section, using the local-exec model. At boot, the Freedom Metal crt0 carves
+ * a block out of the top of each hart's stack, large enough to hold the
+ * section, zeroes it and points the tp register at it. The compiler reaches a
+ * hart-local variable at a constant offset from tp, which the linker relaxes
+ * to a single load or store when the block is smaller than 2 KiB.
+ *
+ * Only the current hart can reach its copy of a variable, so hart-local
+ * storage suits state no other hart looks at. State which other harts read or
+ * update, like the scheduler's run queues or the mailboxes, stays in tables
+ * indexed by hart ID.
+ *
+ * Hart-local variables always start out zeroed on every hart; initializers
+ * are ignored. The block reduces the stack available to each hart by its
+ * size. Hart-local storage is only set up when the program is started by the
+ * Freedom Metal libgloss (--with-builtin-libgloss), and the program must not
+ * have other thread-local variables, since tp points at the metal_hart_local
+ * section alone.
+ */
+
+/*!
+ * @def METAL_HART_LOCAL
+ * @brief Declare a hart-local variable
+ *
+ * For example:
+ *
+ *     METAL_HART_LOCAL unsigned long my_counter;
+ *
+ *     metal_hart_local(my_counter)++;
+ */
+#define METAL_HART_LOCAL \
+	__thread __attribute__((section("metal_hart_local"), tls_model("local-exec")))
+
+/* The hart ID stored in every hart-local block by crt0 */
+extern METAL_HART_LOCAL int __metal_hart_local_hartid;
+
+/*!
+ * @brief Get the base address of the current hart's hart-local block
+ * @return The value of the tp register
+ */
+__inline__ uintptr_t metal_hart_local_base(void) {
+    uintptr_t tp;
+    __asm__ ("mv %0, tp" : "=r" (tp));
+    return tp;
+}
+
+/*!
+ * @def metal_hart_local_ptr
+ * @brief Get a pointer to the current hart's copy of a hart-local variable
+ * @param var A variable declared with METAL_HART_LOCAL
+ */
+#define metal_hart_local_ptr(var) (&(var))
+
+/*!
+ * @def metal_hart_local
+ * @brief Access the current hart's copy of a hart-local variable
+ * @param var A variable declared with METAL_HART_LOCAL
+ *
+ * The result is an lvalue, so it can be both read and assigned.
+ */
+#define metal_hart_local(var) (var)
+
+/*!
+ * @brief Get the ID of the current hart from its hart-local block
+ * @return The hart ID, without reading the mhartid CSR
+ */
+__inline__ int metal_hart_local_hartid(void) {
+    return metal_hart_local(__metal_hart_local_hartid);
+}
+
+#endif /* METAL__HART_LOCAL_H */
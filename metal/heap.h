@@ -0,0 +1,206 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef METAL__HEAP_H
+#define METAL__HEAP_H
+
+#include <stddef.h>
+#include <metal/lock.h>
+#include <metal/memory.h>
+
+/*!
+ * @file heap.h
+ * @brief API for a real-time heap allocator
+ *
+ * The heap is a two-level segregated fit (TLSF) allocator: free blocks are
+ * kept in lists indexed by a power of two size class and a linear subdivision
+ * of it, with a bitmap per level. Allocating and freeing each take a bounded
+ * number of steps whatever the state of the heap, and blocks are merged with
+ * their free neighbours as soon as they are freed.
+ *
+ * A heap can manage several regions of memory which need not be contiguous,
+ * like the heap segment of the program and spare space in a DTIM.
+ *
+ * A heap created with METAL_HEAP_SHARED takes a lock around every operation
+ * so it can be used from any hart. Without it the heap must only be used by
+ * one hart, which avoids the lock. Either way interrupts are disabled during
+ * each operation, so interrupt handlers may allocate too.
+ *
+ * Build with METAL_HEAP_MALLOC to serve malloc(), free() and friends from the
+ * default heap instead of the C library's allocator.
+ */
+
+/*!
+ * @def METAL_HEAP_SHARED
+ * @brief Flag for metal_heap_init() to make a heap usable from every hart
+ *
+ * The heap must then be in memory which supports atomic memory operations.
+ */
+#define METAL_HEAP_SHARED 1
+
+/* Each size class is split into 2^_METAL_HEAP_SL_LOG2 lists */
+#define _METAL_HEAP_SL_LOG2  4
+#define _METAL_HEAP_SL_COUNT (1 << _METAL_HEAP_SL_LOG2)
+
+/* Blocks are aligned to two pointers, like the C library's malloc() */
+#if __riscv_xlen == 64
+#define _METAL_HEAP_ALIGN_LOG2 4
+#define _METAL_HEAP_FL_MAX     32
+#else
+#define _METAL_HEAP_ALIGN_LOG2 3
+#define _METAL_HEAP_FL_MAX     30
+#endif
+
+/* Size classes below 2^_METAL_HEAP_FL_SHIFT share the first level */
+#define _METAL_HEAP_FL_SHIFT (_METAL_HEAP_SL_LOG2 + _METAL_HEAP_ALIGN_LOG2)
+#define _METAL_HEAP_FL_COUNT (_METAL_HEAP_FL_MAX - _METAL_HEAP_FL_SHIFT + 1)
+
+struct _metal_heap_block;
+
+/*!
+ * @brief A handle for a heap
+ */
+struct metal_heap {
+	/* One bit per first level size class with a non-empty list */
+	unsigned int _fl_bitmap;
+	unsigned int _sl_bitmap[_METAL_HEAP_FL_COUNT];
+	struct _metal_heap_block *_free[_METAL_HEAP_FL_COUNT][_METAL_HEAP_SL_COUNT];
+	struct metal_lock _lock;
+	int _flags;
+
+	/* Statistics */
+	size_t _total;
+	size_t _used;
+	size_t _peak_used;
+	unsigned long _allocs;
+	unsigned long _frees;
+	unsigned long _failures;
+	unsigned long _max_alloc_cycles;
+	unsigned long _max_free_cycles;
+};
+
+/*!
+ * @brief Usage and timing statistics for a heap
+ */
+struct metal_heap_stats {
+	/*! The number of bytes managed, including block headers */
+	size_t total;
+	/*! The number of bytes in allocated blocks, including their headers */
+	size_t used;
+	/*! The highest value of used since the heap was created */
+	size_t peak_used;
+	/*! The number of bytes in free blocks */
+	size_t free;
+	/*! The size of the largest free block */
+	size_t largest_free;
+	/*! How much of the free space is unusable for an allocation of
+	 * largest_free bytes, from 0 to 1000 */
+	unsigned int fragmentation;
+	/*! The number of successful allocations */
+	unsigned long allocs;
+	/*! The number of blocks freed */
+	unsigned long frees;
+	/*! The number of allocations which failed */
+	unsigned long failures;
+	/*! The longest an allocation has taken, in cycles */
+	unsigned long max_alloc_cycles;
+	/*! The longest a free has taken, in cycles */
+	unsigned long max_free_cycles;
+};
+
+/*!
+ * @brief Initialize a heap
+ * @param heap The handle for the heap
+ * @param flags 0 for a heap used by one hart, or METAL_HEAP_SHARED
+ * @return 0 upon success
+ *
+ * The heap is empty until memory is added with metal_heap_add_region() or
+ * metal_heap_add_memory().
+ */
+int metal_heap_init(struct metal_heap *heap, int flags);
+
+/*!
+ * @brief Add a region of memory to a heap
+ * @param heap The handle for the heap
+ * @param base The start of the region
+ * @param size The size of the region in bytes
+ * @return 0 upon success, or -1 if the region is too small to use
+ */
+int metal_heap_add_region(struct metal_heap *heap, void *base, size_t size);
+
+/*!
+ * @brief Add part of a memory block to a heap
+ * @param heap The handle for the heap
+ * @param memory The memory block, see memory.h
+ * @param offset The offset of the region to add from the base of the block
+ * @param size The size of the region in bytes, or 0 for the rest of the block
+ * @return 0 upon success, or -1 if the region is not inside the block or
+ * overlaps memory used by the program
+ *
+ * Used to turn spare space in memories like a DTIM or an L2 LIM into heap.
+ * The region is checked against the program's data, BSS, ITIM, DTIM, heap
+ * and stack segments.
+ */
+int metal_heap_add_memory(struct metal_heap *heap, struct metal_memory *memory,
+                          size_t offset, size_t size);
+
+/*!
+ * @brief Get the default heap
+ * @return The handle for the default heap, or NULL if there is no heap
+ * segment
+ *
+ * The default heap is shared, and takes over whatever the C library's
+ * allocator hasn't yet claimed of the heap segment the first time it is used.
+ * From then on malloc() can only reuse memory it already has, unless the
+ * library is built with METAL_HEAP_MALLOC.
+ */
+struct metal_heap *metal_heap_default(void);
+
+/*!
+ * @brief Allocate memory from a heap
+ * @param heap The handle for the heap
+ * @param size The number of bytes to allocate
+ * @return The allocated memory, or NULL if there is no free block large enough
+ */
+void *metal_heap_alloc(struct metal_heap *heap, size_t size);
+
+/*!
+ * @brief Allocate aligned memory from a heap
+ * @param heap The handle for the heap
+ * @param align The alignment in bytes, which must be a power of two
+ * @param size The number of bytes to allocate
+ * @return The allocated memory, or NULL if there is no free block large enough
+ */
+void *metal_heap_aligned_alloc(struct metal_heap *heap, size_t align, size_t size);
+
+/*!
+ * @brief Resize memory allocated from a heap
+ * @param heap The handle for the heap
+ * @param ptr The memory to resize, or NULL to allocate
+ * @param size The new size in bytes
+ * @return The resized memory, which may have moved, or NULL if it couldn't be
+ * resized, in which case ptr is left alone
+ *
+ * Grows in place if the next block is free. Otherwise copies, which takes
+ * time proportional to the size.
+ */
+void *metal_heap_realloc(struct metal_heap *heap, void *ptr, size_t size);
+
+/*!
+ * @brief Return memory to a heap
+ * @param heap The handle for the heap the memory was allocated from
+ * @param ptr The memory to free, or NULL
+ */
+void metal_heap_free(struct metal_heap *heap, void *ptr);
+
+/*!
+ * @brief Get usage and timing statistics for a heap
+ * @param heap The handle for the heap
+ * @param stats Filled in with the statistics
+ *
+ * Finding the largest free block walks one free list, so this doesn't have
+ * the bounded run time of the other operations.
+ */
+void metal_heap_get_stats(struct metal_heap *heap, struct metal_heap_stats *stats);
+
+#endif /* METAL__HEAP_H */
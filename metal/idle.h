@@ -0,0 +1,115 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef METAL__IDLE_H
+#define METAL__IDLE_H
+
+/*!
+ * @file idle.h
+ * @brief API for idling a hart without a periodic tick
+ *
+ * Instead of waking up on every tick, an idle hart sleeps in wfi until the
+ * next software timer (see swtimer.h) or any other enabled interrupt. The
+ * time spent idle is accounted per hart.
+ *
+ * When the predicted idle time is long enough, the hart enters deep idle
+ * through metal_idle_deep_enter(), which a platform can redefine to stop
+ * clocks or enter a low power state. Drivers which can't tolerate that, for
+ * example while a transfer is in flight, register a veto.
+ */
+
+/*!
+ * @def METAL_IDLE_DEEP_MIN_TICKS
+ * @brief The shortest predicted idle time, in mtime ticks, for deep idle
+ */
+#ifndef METAL_IDLE_DEEP_MIN_TICKS
+#define METAL_IDLE_DEEP_MIN_TICKS 1000
+#endif
+
+/*!
+ * @def METAL_IDLE_MAX_VETOES
+ * @brief The maximum number of deep idle vetoes which can be registered
+ */
+#ifndef METAL_IDLE_MAX_VETOES
+#define METAL_IDLE_MAX_VETOES 8
+#endif
+
+/*!
+ * @brief A function which can prevent deep idle
+ * @param arg The argument given to metal_idle_veto_register()
+ * @param ticks The predicted idle time in mtime ticks, or ULLONG_MAX if no
+ * timer is pending
+ * @return Non-zero to keep the hart out of deep idle
+ */
+typedef int (*metal_idle_veto)(void *arg, unsigned long long ticks);
+
+/*!
+ * @brief Idle residency statistics for one hart
+ */
+struct metal_idle_stats {
+    /* The number of times the hart went idle */
+    unsigned long long entries;
+    /* How many of those were deep idle */
+    unsigned long long deep_entries;
+    /* How many deep idles were prevented by a veto */
+    unsigned long long vetoed;
+    /* The total time spent idle, in mtime ticks */
+    unsigned long long idle_ticks;
+    /* The longest single idle period, in mtime ticks */
+    unsigned long long max_ticks;
+};
+
+/*!
+ * @brief Idle the current hart until the next interrupt
+ *
+ * Returns immediately if a software timer is already due. Otherwise sleeps
+ * until an enabled interrupt is pending, and returns after it is handled.
+ */
+void metal_idle(void);
+
+/*!
+ * @brief Idle the current hart until a deadline or an interrupt
+ * @param deadline The value of mtime to wake up at
+ * @return 0 upon success, or -1 if software timers are not enabled on the
+ * current hart
+ *
+ * The deadline is programmed through a software timer, so
+ * metal_swtimer_enable() must have been called on the current hart. Returns
+ * early if any other interrupt is taken.
+ */
+int metal_idle_until(unsigned long long deadline);
+
+/*!
+ * @brief Register a function which can prevent deep idle
+ * @param veto The function to call before entering deep idle
+ * @param arg An argument passed through to veto
+ * @return 0 upon success, or -1 if the table of vetoes is full
+ *
+ * Vetoes apply to all harts and should be registered before any hart idles.
+ */
+int metal_idle_veto_register(metal_idle_veto veto, void *arg);
+
+/*!
+ * @brief Enter deep idle
+ * @param deadline The value of mtime of the next timer event, or ULLONG_MAX
+ *
+ * Called with interrupts disabled, and must return once any enabled interrupt
+ * is pending. The default implementation executes wfi. Platforms redefine
+ * this function to enter a lower power state.
+ */
+void metal_idle_deep_enter(unsigned long long deadline);
+
+/*!
+ * @brief Get the idle statistics of a hart
+ * @param hartid The hart ID to get the statistics of
+ * @param stats Filled in with the statistics
+ * @return 0 upon success
+ */
+int metal_idle_get_stats(int hartid, struct metal_idle_stats *stats);
+
+/*!
+ * @brief Clear the idle statistics of all harts
+ */
+void metal_idle_reset_stats(void);
+
+#endif /* METAL__IDLE_H */
@@ -7,6 +7,32 @@
 /*! @file itim.h
  *
  * API for manipulating ITIM allocation
+ *
+ * Code which doesn't all fit in the ITIM at once can be split into overlays,
+ * which share one region of the ITIM and are loaded into it from flash on
+ * demand. Each overlay is a group of functions marked with
+ * METAL_ITIM_OVERLAY(name).
+ *
+ * The linker script must link the section .itim_overlay.NAME of each
+ * overlay into an output section .itim_overlay_NAME, with all of them in one
+ * OVERLAY statement whose address is metal_segment_itim_overlay_target_start,
+ * and define metal_segment_itim_overlay_target_end at the end of the region.
+ * For example:
+ *
+ *     metal_segment_itim_overlay_target_start = .;
+ *     OVERLAY : NOCROSSREFS {
+ *         .itim_overlay_dsp { *(.itim_overlay.dsp) }
+ *         .itim_overlay_crypto { *(.itim_overlay.crypto) }
+ *     } >itim AT>flash
+ *     metal_segment_itim_overlay_target_end = ORIGIN(itim) + LENGTH(itim);
+ *
+ * Callers outside an overlay reach its functions through stubs made with
+ * METAL_ITIM_OVERLAY_STUB(), which load the overlay first if needed, so they
+ * don't need to know where the code lives. Code in one overlay must not call
+ * into another, since loading the second would overwrite the caller.
+ *
+ * The region belongs to the hart whose ITIM it is, so overlays must only be
+ * loaded and called from that hart.
  */
 
 
@@ -18,4 +44,86 @@
  */
 #define METAL_PLACE_IN_ITIM	__attribute__((section(".itim")))
 
+/*!
+ * @brief A handle for an ITIM overlay
+ */
+struct metal_itim_overlay {
+	const char *_name;
+	const char *_load_start;
+	const char *_load_end;
+};
+
+/*! @def METAL_ITIM_OVERLAY
+ * @brief Link a function into an ITIM overlay
+ *
+ * The function is linked into the section .itim_overlay.NAME, and never
+ * inlined into callers outside the overlay.
+ */
+#define METAL_ITIM_OVERLAY(name) \
+		__attribute__((section(".itim_overlay." #name), noinline))
+
+/*! @def METAL_ITIM_OVERLAY_DECLARE
+ * @brief Define the handle for an ITIM overlay
+ *
+ * The handle is called metal_itim_overlay_NAME, and must be defined once in
+ * the program for each overlay.
+ */
+#define METAL_ITIM_OVERLAY_DECLARE(name) \
+		extern const char __load_start_itim_overlay_##name[]; \
+		extern const char __load_stop_itim_overlay_##name[]; \
+		const struct metal_itim_overlay metal_itim_overlay_##name = { \
+			._name = #name, \
+			._load_start = __load_start_itim_overlay_##name, \
+			._load_end = __load_stop_itim_overlay_##name, \
+		}
+
+/*! @def METAL_ITIM_OVERLAY_EXTERN
+ * @brief Declare the handle for an ITIM overlay defined elsewhere
+ */
+#define METAL_ITIM_OVERLAY_EXTERN(name) \
+		extern const struct metal_itim_overlay metal_itim_overlay_##name
+
+/*! @def METAL_ITIM_OVERLAY_STUB
+ * @brief Define a stub which calls a function in an ITIM overlay
+ *
+ * The stub loads the overlay if it isn't already in the ITIM, then jumps to
+ * target with the caller's arguments, so it can be declared and called with
+ * the same prototype as target:
+ *
+ *     METAL_ITIM_OVERLAY(dsp) void fir(int *out, const int *in, int n);
+ *     METAL_ITIM_OVERLAY_STUB(dsp, fir_stub, fir);
+ *     void fir_stub(int *out, const int *in, int n);
+ *
+ * Arguments passed on the stack are untouched, so any prototype works. When
+ * the overlay is already loaded the stub costs a load, a compare and two
+ * jumps.
+ */
+#define METAL_ITIM_OVERLAY_STUB(name, stub, target) \
+		__asm__(".section .text." #stub ",\"ax\",@progbits\n" \
+			".global " #stub "\n" \
+			".type " #stub ", @function\n" \
+			#stub ":\n" \
+			"la t0, metal_itim_overlay_" #name "\n" \
+			"la t2, " #target "\n" \
+			"tail _metal_itim_overlay_enter\n" \
+			".size " #stub ", . - " #stub "\n" \
+			".previous\n")
+
+/*!
+ * @brief Load an overlay into the ITIM
+ * @param overlay The handle for the overlay
+ * @return 0 upon success, or -1 if the overlay doesn't fit in the region
+ *
+ * Copies the overlay over whichever was loaded before and synchronizes the
+ * instruction stream, so its functions may be called directly afterwards.
+ * Does nothing if the overlay is already loaded.
+ */
+int metal_itim_load(const struct metal_itim_overlay *overlay);
+
+/*!
+ * @brief Get the overlay which is loaded into the ITIM
+ * @return The handle for the overlay, or NULL if none is loaded
+ */
+const struct metal_itim_overlay *metal_itim_loaded(void);
+
 #endif
@@ -8,6 +8,8 @@
 #include <metal/memory.h>
 #include <metal/compiler.h>
 
+struct metal_sched_task;
+
 #ifdef __ICCRISCV__
 #define __asm__ asm
 #endif
@@ -22,6 +24,36 @@
 #define METAL_LOCK_BACKOFF_CYCLES 32
 #define METAL_LOCK_BACKOFF_EXPONENT 2
 
+/*!
+ * @def METAL_LOCK_PROFILE
+ * @brief Build locks with contention profiling
+ *
+ * When METAL_LOCK_PROFILE is defined, every lock records how often it is
+ * taken, how often it was found held, the cycles spent spinning for it, its
+ * longest hold time and the hart which currently owns it. The statistics
+ * can be printed with metal_lock_profile_dump(). The library and the
+ * application must be built with the same setting.
+ */
+
+/*!
+ * @def METAL_LOCK_PRIORITY_INHERIT
+ * @brief Build locks with priority inheritance for the preemptive scheduler
+ *
+ * When METAL_LOCK_PRIORITY_INHERIT is defined, every lock records which
+ * scheduler task (see sched.h) holds it. A task which finds the lock held
+ * raises the holder to its own priority until the lock is given back, and
+ * yields if the holder runs on the same hart instead of spinning. The library
+ * and the application must be built with the same setting.
+ */
+
+/*!
+ * @def METAL_LOCK_PROFILE_MAX_LOCKS
+ * @brief The maximum number of locks tracked by the lock profiler
+ */
+#ifndef METAL_LOCK_PROFILE_MAX_LOCKS
+#define METAL_LOCK_PROFILE_MAX_LOCKS 32
+#endif
+
 /*!
  * @def METAL_LOCK_DECLARE
  * @brief Declare a lock
@@ -29,17 +61,74 @@
  * Locks must be declared with METAL_LOCK_DECLARE to ensure that the lock
  * is linked into a memory region which supports atomic memory operations.
  */
+#ifdef METAL_LOCK_PROFILE
+#define METAL_LOCK_DECLARE(name) \
+		__attribute__((section(".data.locks"))) \
+		struct metal_lock name = { ._stats = { ._name = #name, ._owner = -1 } }
+#else
 #define METAL_LOCK_DECLARE(name) \
 		__attribute__((section(".data.locks"))) \
 		struct metal_lock name
+#endif
+
+/*!
+ * @brief Contention statistics kept for a lock when METAL_LOCK_PROFILE is defined
+ *
+ * All fields except _owner are only written by the hart holding the lock.
+ */
+struct metal_lock_stats {
+	const char *_name;
+	unsigned long _acquisitions;
+	unsigned long _contended;
+	unsigned long long _spin_cycles;
+	unsigned long long _max_hold_cycles;
+	unsigned long long _taken_at;
+	int _owner;
+};
 
 /*!
  * @brief A handle for a lock
  */
 struct metal_lock {
 	int _state;
+#ifdef METAL_LOCK_PRIORITY_INHERIT
+	struct metal_sched_task *_holder;
+#endif
+#ifdef METAL_LOCK_PROFILE
+	struct metal_lock_stats _stats;
+#endif
 };
 
+#ifdef METAL_LOCK_PRIORITY_INHERIT
+/* Hooks called by the lock functions, implemented in sched.c */
+void _metal_sched_lock_taken(struct metal_lock *lock);
+void _metal_sched_lock_given(struct metal_sched_task *holder);
+void _metal_sched_lock_contended(struct metal_lock *lock);
+#endif
+
+#ifdef METAL_LOCK_PROFILE
+/* Hooks called by the instrumented lock functions, implemented in lock.c */
+unsigned long long _metal_lock_profile_cycles(void);
+void _metal_lock_profile_register(struct metal_lock *lock);
+void _metal_lock_profile_taken(struct metal_lock *lock, unsigned long long start, int contended);
+void _metal_lock_profile_given(struct metal_lock *lock);
+#endif
+
+/*!
+ * @brief Print the most contended locks to the default output device
+ * @param top The maximum number of locks to print, or 0 to print all of them
+ *
+ * Locks are ordered by the total number of cycles harts spent spinning on
+ * them. Only locks which have been initialized with metal_lock_init() are
+ * reported. Without METAL_LOCK_PROFILE this prints nothing.
+ */
+void metal_lock_profile_dump(unsigned int top);
+
+/*!
+ * @brief Clear the statistics of every profiled lock
+ */
+void metal_lock_profile_reset(void);
+
 /*!
  * @brief Initialize a lock
  * @param lock The handle for a lock
@@ -63,6 +152,14 @@ __inline__ int metal_lock_init(struct metal_lock *lock) {
 
     lock->_state = 0;
 
+#ifdef METAL_LOCK_PRIORITY_INHERIT
+    lock->_holder = 0;
+#endif
+
+#ifdef METAL_LOCK_PROFILE
+    _metal_lock_profile_register(lock);
+#endif
+
     return 0;
 #else
     return 3;
@@ -85,6 +182,11 @@ __inline__ int metal_lock_take(struct metal_lock *lock) {
     int backoff = 1;
     const int max_backoff = METAL_LOCK_BACKOFF_CYCLES * METAL_MAX_CORES;
 
+#ifdef METAL_LOCK_PROFILE
+    unsigned long long start = _metal_lock_profile_cycles();
+    int contended = 0;
+#endif
+
     while(1) {
         __asm__ volatile("amoswap.w.aq %[old], %[new], (%[state])"
                          : [old] "=r" (old)
@@ -95,6 +197,14 @@ __inline__ int metal_lock_take(struct metal_lock *lock) {
             break;
         }
 
+#ifdef METAL_LOCK_PROFILE
+        contended = 1;
+#endif
+
+#ifdef METAL_LOCK_PRIORITY_INHERIT
+        _metal_sched_lock_contended(lock);
+#endif
+
         for (int i = 0; i < backoff; i++) {
             __asm__ volatile("");
         }
@@ -104,6 +214,14 @@ __inline__ int metal_lock_take(struct metal_lock *lock) {
         }
     }
 
+#ifdef METAL_LOCK_PRIORITY_INHERIT
+    _metal_sched_lock_taken(lock);
+#endif
+
+#ifdef METAL_LOCK_PROFILE
+    _metal_lock_profile_taken(lock, start, contended);
+#endif
+
     return 0;
 #else
     /* Store the memory address in mtval like a normal store/amo access fault */
@@ -128,10 +246,25 @@ __inline__ int metal_lock_take(struct metal_lock *lock) {
  */
 __inline__ int metal_lock_give(struct metal_lock *lock) {
 #ifdef __riscv_atomic
+#ifdef METAL_LOCK_PROFILE
+    _metal_lock_profile_given(lock);
+#endif
+
+#ifdef METAL_LOCK_PRIORITY_INHERIT
+    struct metal_sched_task *holder = lock->_holder;
+    lock->_holder = 0;
+#endif
+
     __asm__ volatile("amoswap.w.rl x0, x0, (%[state])"
                      :: [state] "r" (&(lock->_state))
                      : "memory");
 
+#ifdef METAL_LOCK_PRIORITY_INHERIT
+    /* Only after the lock is free, so the waiter we were boosted for can
+     * take it as soon as we drop back */
+    _metal_sched_lock_given(holder);
+#endif
+
     return 0;
 #else
     /* Store the memory address in mtval like a normal store/amo access fault */
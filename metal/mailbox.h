@@ -0,0 +1,97 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef METAL__MAILBOX_H
+#define METAL__MAILBOX_H
+
+/*!
+ * @file mailbox.h
+ * @brief API for calling functions on other harts
+ *
+ * Each hart has a mailbox, a lock-free queue of function calls which any hart
+ * can post to. Posting a call raises the target hart's software interrupt,
+ * and the CPU interrupt controller's software interrupt handler runs the
+ * queued calls. Only the first call posted to an empty
+ * mailbox raises the interrupt, so calls posted in a burst, or to many harts
+ * at once, share one interrupt per hart.
+ *
+ * The handler registered for the software interrupt still sees every
+ * software interrupt, including those raised only to deliver calls, and runs
+ * before the queued calls. It must clear the interrupt, as it would without
+ * the mailbox.
+ */
+
+/*!
+ * @def METAL_MAILBOX_DEPTH
+ * @brief The number of calls each mailbox can hold, which must be a power of
+ * two
+ *
+ * Posting to a full mailbox waits for the target hart to make room.
+ */
+#ifndef METAL_MAILBOX_DEPTH
+#define METAL_MAILBOX_DEPTH 16
+#endif
+
+/*!
+ * @brief A function called on another hart
+ * @param arg The argument given to metal_hart_call()
+ *
+ * Runs in interrupt context on the target hart.
+ */
+typedef void (*metal_hart_call_fn)(void *arg);
+
+/*!
+ * @brief Start taking calls on the current hart
+ * @return 0 upon success
+ *
+ * Enables the hart's software interrupt. Machine interrupts must also be
+ * enabled on the CPU interrupt controller for calls to run, otherwise they
+ * wait until metal_mailbox_poll() is called.
+ */
+int metal_mailbox_enable(void);
+
+/*!
+ * @brief Run the calls waiting in the current hart's mailbox
+ * @return The number of calls run
+ */
+int metal_mailbox_poll(void);
+
+/*!
+ * @brief Call a function on a hart
+ * @param hartid The hart to run the function on
+ * @param fn The function to run
+ * @param arg The argument to pass to fn
+ * @param wait Non-zero to return only once fn has returned
+ * @return 0 upon success
+ *
+ * A call to the current hart runs immediately. While waiting, the current
+ * hart keeps running calls posted to its own mailbox, so two harts can wait
+ * on each other without deadlock. A waiting caller's stack must support
+ * atomic memory operations.
+ */
+int metal_hart_call(int hartid, metal_hart_call_fn fn, void *arg, int wait);
+
+/*!
+ * @brief Call a function on a set of harts
+ * @param harts A mask with bit n set to call the function on hart n
+ * @param fn The function to run
+ * @param arg The argument to pass to fn
+ * @param wait Non-zero to return only once fn has returned on every hart
+ * @return 0 upon success, or -1 if any hart could not be called
+ *
+ * The calls are posted to every hart before any is waited for, so the harts
+ * run them in parallel.
+ */
+int metal_hart_call_many(unsigned long harts, metal_hart_call_fn fn, void *arg,
+                         int wait);
+
+/*!
+ * @brief Call a function on every hart except the current one
+ * @param fn The function to run
+ * @param arg The argument to pass to fn
+ * @param wait Non-zero to return only once fn has returned on every hart
+ * @return 0 upon success
+ */
+int metal_hart_call_others(metal_hart_call_fn fn, void *arg, int wait);
+
+#endif /* METAL__MAILBOX_H */
@@ -13,6 +13,36 @@
  * @brief API for enumerating memory blocks
  */
 
+/*!
+ * @def METAL_MEMORY_READABLE
+ * @brief Set by metal_memory_attributes() for readable memory
+ */
+#define METAL_MEMORY_READABLE (1 << 0)
+
+/*!
+ * @def METAL_MEMORY_WRITABLE
+ * @brief Set by metal_memory_attributes() for writable memory
+ */
+#define METAL_MEMORY_WRITABLE (1 << 1)
+
+/*!
+ * @def METAL_MEMORY_EXECUTABLE
+ * @brief Set by metal_memory_attributes() for executable memory
+ */
+#define METAL_MEMORY_EXECUTABLE (1 << 2)
+
+/*!
+ * @def METAL_MEMORY_CACHEABLE
+ * @brief Set by metal_memory_attributes() for cacheable memory
+ */
+#define METAL_MEMORY_CACHEABLE (1 << 3)
+
+/*!
+ * @def METAL_MEMORY_ATOMIC
+ * @brief Set by metal_memory_attributes() for memory which supports atomics
+ */
+#define METAL_MEMORY_ATOMIC (1 << 4)
+
 struct _metal_memory_attributes {
 	unsigned int R : 1;
 	unsigned int W : 1;
@@ -38,9 +68,25 @@ struct metal_memory {
  *
  * @param address The address to query
  * @return The memory block handle, or NULL if the address is not mapped to a memory block
+ *
+ * Memory blocks are found by binary search, and the block found last is
+ * checked first.
  */
 struct metal_memory *metal_get_memory_from_address(const uintptr_t address);
 
+/*!
+ * @brief Get the attributes shared by every byte of an address range
+ *
+ * The range may span several adjacent memory blocks, for example before
+ * setting up a DMA transfer or checking that a buffer is cacheable.
+ *
+ * @param address The start of the range
+ * @param len The length of the range in bytes
+ * @return A mask of the METAL_MEMORY_* attributes which apply to the whole
+ * range, or -1 if part of the range is not mapped to a memory block
+ */
+int metal_memory_attributes(const uintptr_t address, size_t len);
+
 /*!
  * @brief Get the base address for a memory block
  * @param memory The handle for the memory block
@@ -0,0 +1,69 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef METAL__PARALLEL_H
+#define METAL__PARALLEL_H
+
+/*!
+ * @file parallel.h
+ * @brief API for spreading loops across all harts
+ *
+ * Secondary harts which are started by the Freedom Metal crt0 enter
+ * metal_parallel_worker() instead of sleeping forever whenever this API is
+ * linked into the program. Each hart then owns a deque of pending work. A
+ * hart splits the range it is working on in halves, keeps the lower half and
+ * pushes the upper half onto its own deque, where idle harts can steal it.
+ * Idle harts sleep in wfi and are woken with a software interrupt when new
+ * work is pushed. A worker enables the mailbox (see mailbox.h) on its hart and
+ * runs work with machine interrupts enabled, turning them off only while it
+ * sleeps.
+ *
+ * Programs which define their own secondary_main can call
+ * metal_parallel_worker() from it on the harts which should take part.
+ */
+
+/*!
+ * @def METAL_PARALLEL_DEQUE_SIZE
+ * @brief The number of ranges each hart can hold for stealing
+ *
+ * Must be a power of two. When a deque is full, the hart stops splitting and
+ * works through its range itself.
+ */
+#ifndef METAL_PARALLEL_DEQUE_SIZE
+#define METAL_PARALLEL_DEQUE_SIZE 64
+#endif
+
+/*!
+ * @brief The function called on each piece of a parallel loop
+ * @param begin The first index of the piece
+ * @param end One past the last index of the piece
+ * @param arg The argument passed to metal_parallel_for()
+ */
+typedef void (*metal_parallel_fn)(unsigned long begin, unsigned long end, void *arg);
+
+/*!
+ * @brief Run a loop on all available harts
+ * @param begin The first index of the loop
+ * @param end One past the last index of the loop
+ * @param grain The largest piece which is not split any further
+ * @param fn The function to call on every piece
+ * @param arg An argument passed through to fn
+ * @return 0 once fn has been called on every index in [begin, end)
+ *
+ * The calling hart takes part in the loop and only returns when all pieces
+ * are complete. fn may be called concurrently on different harts, and may
+ * itself call metal_parallel_for(). If the target does not support atomics,
+ * fn is called once on the whole range by the calling hart.
+ */
+int metal_parallel_for(unsigned long begin, unsigned long end,
+                       unsigned long grain, metal_parallel_fn fn, void *arg);
+
+/*!
+ * @brief Execute work from metal_parallel_for() on the calling hart
+ *
+ * Does not return. The calling hart sleeps when there is no work, and must
+ * not be the hart which runs main().
+ */
+void metal_parallel_worker(void) __attribute__((noreturn));
+
+#endif /* METAL__PARALLEL_H */
@@ -0,0 +1,157 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef METAL__POOL_H
+#define METAL__POOL_H
+
+#include <stddef.h>
+#include <metal/lock.h>
+
+/*!
+ * @file pool.h
+ * @brief API for fixed-size object pools
+ *
+ * A pool hands out objects of one size from statically declared storage.
+ * Free objects are kept on a list threaded through the objects themselves, so
+ * allocating and freeing take constant time and the pool has no overhead per
+ * object.
+ *
+ * Each hart keeps a small magazine of objects, and only takes the pool's lock
+ * to refill or empty it in batches. Objects freed on one hart may be reused on
+ * another, but only once they have gone back to the shared free list: an
+ * allocation fails when the free list and its own hart's magazine are empty,
+ * even if other harts still have objects cached. Such failures are counted
+ * separately from the pool running out, see metal_pool_stats.
+ *
+ * The storage can be placed in the DTIM with the macros from metal/dtim.h,
+ * for example:
+ *
+ *     METAL_PLACE_IN_DTIM_ZERO METAL_POOL_DECLARE_STORAGE(buffers, 256, 32);
+ *     METAL_POOL_DECLARE(buffer_pool);
+ *
+ *     metal_pool_init(&buffer_pool, buffers, 256, 32);
+ */
+
+/*!
+ * @def METAL_POOL_MAGAZINE_SIZE
+ * @brief The maximum number of free objects each hart caches
+ *
+ * Pools with fewer than twice this many objects per hart use smaller
+ * magazines, so at most half of a pool is ever cached. Size pools with that
+ * headroom in mind.
+ */
+#ifndef METAL_POOL_MAGAZINE_SIZE
+#define METAL_POOL_MAGAZINE_SIZE 8
+#endif
+
+/* Objects are aligned to two pointers, like the C library's malloc() */
+#define _METAL_POOL_ALIGN (2 * sizeof(void *))
+#define _METAL_POOL_STRIDE(obj_size) \
+	(((obj_size) + _METAL_POOL_ALIGN - 1) & ~(_METAL_POOL_ALIGN - 1))
+
+/*!
+ * @def METAL_POOL_STORAGE_SIZE
+ * @brief The number of bytes of storage needed for a pool
+ */
+#define METAL_POOL_STORAGE_SIZE(obj_size, count) \
+	((count) * _METAL_POOL_STRIDE(obj_size))
+
+/*!
+ * @def METAL_POOL_DECLARE_STORAGE
+ * @brief Declare correctly sized and aligned storage for a pool
+ */
+#define METAL_POOL_DECLARE_STORAGE(name, obj_size, count) \
+		unsigned char name[METAL_POOL_STORAGE_SIZE(obj_size, count)] \
+		__attribute__((aligned(2 * sizeof(void *))))
+
+/*!
+ * @def METAL_POOL_DECLARE
+ * @brief Declare a pool
+ *
+ * The pool holds a lock, so it must be linked into a memory region which
+ * supports atomic memory operations.
+ */
+#define METAL_POOL_DECLARE(name) \
+		__attribute__((section(".data.locks"))) \
+		struct metal_pool name
+
+/* Kept on its own cache line, since only its hart writes it */
+struct _metal_pool_magazine {
+	unsigned int _count;
+	void *_objs[METAL_POOL_MAGAZINE_SIZE];
+} __attribute__((aligned(64)));
+
+/*!
+ * @brief A handle for a pool
+ */
+struct metal_pool {
+	struct metal_lock _lock;
+	/* The free list, linked through the first word of each object */
+	void *_free;
+	unsigned char *_storage;
+	size_t _stride;
+	unsigned int _count;
+	unsigned int _mag_size;
+	unsigned int _in_use;
+	unsigned int _high_water;
+	unsigned long _failures;
+	unsigned long _stranded;
+	struct _metal_pool_magazine _mags[__METAL_DT_MAX_HARTS];
+};
+
+/*!
+ * @brief Usage statistics for a pool
+ */
+struct metal_pool_stats {
+	/*! The number of objects in the pool */
+	unsigned int count;
+	/*! The number of objects currently allocated */
+	unsigned int in_use;
+	/*! The highest value of in_use since the pool was initialized */
+	unsigned int high_water;
+	/*! The number of allocations which failed because the pool was empty */
+	unsigned long failures;
+	/*! The number of allocations which failed while other harts' magazines
+	 * still held free objects */
+	unsigned long stranded;
+};
+
+/*!
+ * @brief Initialize a pool
+ * @param pool The handle for the pool
+ * @param storage At least METAL_POOL_STORAGE_SIZE(obj_size, count) bytes,
+ * aligned to two pointers
+ * @param obj_size The size of each object in bytes
+ * @param count The number of objects
+ * @return 0 upon success
+ */
+int metal_pool_init(struct metal_pool *pool, void *storage, size_t obj_size,
+                    unsigned int count);
+
+/*!
+ * @brief Allocate an object from a pool
+ * @param pool The handle for the pool
+ * @return The object, or NULL if the pool is empty or its only free objects
+ * are cached on other harts
+ *
+ * May be called from interrupt handlers.
+ */
+void *metal_pool_alloc(struct metal_pool *pool);
+
+/*!
+ * @brief Return an object to a pool
+ * @param pool The handle for the pool the object came from
+ * @param obj The object, or NULL
+ *
+ * May be called from interrupt handlers, and on any hart.
+ */
+void metal_pool_free(struct metal_pool *pool, void *obj);
+
+/*!
+ * @brief Get usage statistics for a pool
+ * @param pool The handle for the pool
+ * @param stats Filled in with the statistics
+ */
+void metal_pool_get_stats(struct metal_pool *pool, struct metal_pool_stats *stats);
+
+#endif /* METAL__POOL_H */
@@ -0,0 +1,224 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef METAL__RINGBUF_H
+#define METAL__RINGBUF_H
+
+#include <stddef.h>
+#include <metal/io.h>
+
+/*!
+ * @file ringbuf.h
+ * @brief API for bounded lock-free ring buffers
+ *
+ * Two ring buffers are provided. The single-producer single-consumer ring
+ * (metal_spsc_ringbuf) only uses plain loads, stores and fences, so it works
+ * in any memory and is suited to passing data between an interrupt handler and
+ * the main loop. The multi-producer multi-consumer ring (metal_mpmc_ringbuf)
+ * claims slots with atomic memory operations and can be shared by any number
+ * of harts.
+ *
+ * Both rings hold fixed-size elements in caller-provided storage. The number
+ * of elements must be a power of two.
+ */
+
+/*!
+ * @def METAL_RINGBUF_CACHE_LINE
+ * @brief The alignment used to keep producer and consumer state apart
+ */
+#ifndef METAL_RINGBUF_CACHE_LINE
+#define METAL_RINGBUF_CACHE_LINE 64
+#endif
+
+/*!
+ * @def METAL_MPMC_RINGBUF_DECLARE
+ * @brief Declare a multi-producer multi-consumer ring buffer
+ *
+ * The indices of an MPMC ring are updated with atomic memory operations, so
+ * it must be linked into a memory region which supports them, like a lock.
+ */
+#define METAL_MPMC_RINGBUF_DECLARE(name) \
+		__attribute__((section(".data.locks"))) \
+		struct metal_mpmc_ringbuf name
+
+/*!
+ * @brief A handle for a single-producer single-consumer ring buffer
+ */
+struct metal_spsc_ringbuf {
+	/* Written by the producer */
+	unsigned int _head __attribute__((aligned(METAL_RINGBUF_CACHE_LINE)));
+	unsigned int _cached_tail;
+
+	/* Written by the consumer */
+	unsigned int _tail __attribute__((aligned(METAL_RINGBUF_CACHE_LINE)));
+	unsigned int _cached_head;
+
+	/* Constant after initialization */
+	unsigned char *_buffer __attribute__((aligned(METAL_RINGBUF_CACHE_LINE)));
+	size_t _elem_size;
+	unsigned int _mask;
+};
+
+/*!
+ * @brief A handle for a multi-producer multi-consumer ring buffer
+ */
+struct metal_mpmc_ringbuf {
+	unsigned int _enqueue_pos __attribute__((aligned(METAL_RINGBUF_CACHE_LINE)));
+	unsigned int _dequeue_pos __attribute__((aligned(METAL_RINGBUF_CACHE_LINE)));
+
+	/* Constant after initialization */
+	unsigned int *_seq __attribute__((aligned(METAL_RINGBUF_CACHE_LINE)));
+	unsigned char *_buffer;
+	size_t _elem_size;
+	unsigned int _mask;
+};
+
+/*!
+ * @brief Initialize a single-producer single-consumer ring buffer
+ * @param rb The handle for the ring buffer
+ * @param buffer Storage for at least capacity elements
+ * @param elem_size The size of one element in bytes
+ * @param capacity The number of elements, which must be a power of two
+ * @return 0 if the ring buffer is successfully initialized
+ */
+int metal_spsc_ringbuf_init(struct metal_spsc_ringbuf *rb, void *buffer,
+                            size_t elem_size, unsigned int capacity);
+
+/*!
+ * @brief Copy elements into a ring buffer
+ * @param rb The handle for the ring buffer
+ * @param elems The elements to enqueue
+ * @param count The number of elements to enqueue
+ * @return The number of elements enqueued, which is less than count if the
+ * ring buffer filled up
+ *
+ * Must only be called by the producer.
+ */
+unsigned int metal_spsc_ringbuf_enqueue(struct metal_spsc_ringbuf *rb,
+                                        const void *elems, unsigned int count);
+
+/*!
+ * @brief Copy elements out of a ring buffer
+ * @param rb The handle for the ring buffer
+ * @param elems Storage for the dequeued elements
+ * @param count The maximum number of elements to dequeue
+ * @return The number of elements dequeued
+ *
+ * Must only be called by the consumer.
+ */
+unsigned int metal_spsc_ringbuf_dequeue(struct metal_spsc_ringbuf *rb,
+                                        void *elems, unsigned int count);
+
+/*!
+ * @brief Reserve space in a ring buffer to be filled in place
+ * @param rb The handle for the ring buffer
+ * @param elems Set to the first reserved element
+ * @return The number of contiguous elements which may be written at elems
+ *
+ * The elements are published to the consumer by metal_spsc_ringbuf_commit().
+ * Must only be called by the producer.
+ */
+unsigned int metal_spsc_ringbuf_reserve(struct metal_spsc_ringbuf *rb, void **elems);
+
+/*!
+ * @brief Publish elements written after metal_spsc_ringbuf_reserve()
+ * @param rb The handle for the ring buffer
+ * @param count The number of elements to publish, at most the number reserved
+ */
+void metal_spsc_ringbuf_commit(struct metal_spsc_ringbuf *rb, unsigned int count);
+
+/*!
+ * @brief Get the elements at the front of a ring buffer without copying them
+ * @param rb The handle for the ring buffer
+ * @param elems Set to the first available element
+ * @return The number of contiguous elements which may be read at elems
+ *
+ * The elements are returned to the producer by metal_spsc_ringbuf_consume().
+ * Must only be called by the consumer.
+ */
+unsigned int metal_spsc_ringbuf_peek(struct metal_spsc_ringbuf *rb, void **elems);
+
+/*!
+ * @brief Release elements read after metal_spsc_ringbuf_peek()
+ * @param rb The handle for the ring buffer
+ * @param count The number of elements to release, at most the number peeked
+ */
+void metal_spsc_ringbuf_consume(struct metal_spsc_ringbuf *rb, unsigned int count);
+
+/*!
+ * @brief Get the number of elements in a ring buffer
+ * @param rb The handle for the ring buffer
+ * @return The number of elements waiting to be dequeued
+ */
+__inline__ unsigned int metal_spsc_ringbuf_count(struct metal_spsc_ringbuf *rb) {
+	return __METAL_ACCESS_ONCE(&rb->_head) - __METAL_ACCESS_ONCE(&rb->_tail);
+}
+
+/*!
+ * @brief Initialize a multi-producer multi-consumer ring buffer
+ * @param rb The handle for the ring buffer
+ * @param buffer Storage for at least capacity elements
+ * @param seq Storage for capacity sequence numbers
+ * @param elem_size The size of one element in bytes
+ * @param capacity The number of elements, which must be a power of two
+ * @return 0 if the ring buffer is successfully initialized. A non-zero code
+ * indicates failure, including when the target does not support atomics.
+ */
+int metal_mpmc_ringbuf_init(struct metal_mpmc_ringbuf *rb, void *buffer,
+                            unsigned int *seq, size_t elem_size,
+                            unsigned int capacity);
+
+/*!
+ * @brief Copy elements into a ring buffer
+ * @param rb The handle for the ring buffer
+ * @param elems The elements to enqueue
+ * @param count The number of elements to enqueue
+ * @return The number of elements enqueued
+ *
+ * Elements enqueued by one call are not guaranteed to be adjacent if other
+ * producers run concurrently.
+ */
+unsigned int metal_mpmc_ringbuf_enqueue(struct metal_mpmc_ringbuf *rb,
+                                        const void *elems, unsigned int count);
+
+/*!
+ * @brief Copy elements out of a ring buffer
+ * @param rb The handle for the ring buffer
+ * @param elems Storage for the dequeued elements
+ * @param count The maximum number of elements to dequeue
+ * @return The number of elements dequeued
+ */
+unsigned int metal_mpmc_ringbuf_dequeue(struct metal_mpmc_ringbuf *rb,
+                                        void *elems, unsigned int count);
+
+/*!
+ * @brief Claim one element of a ring buffer to be filled in place
+ * @param rb The handle for the ring buffer
+ * @param ticket Set to the ticket to pass to metal_mpmc_ringbuf_commit()
+ * @return A pointer to the element, or NULL if the ring buffer is full
+ */
+void *metal_mpmc_ringbuf_reserve(struct metal_mpmc_ringbuf *rb, unsigned int *ticket);
+
+/*!
+ * @brief Publish an element claimed with metal_mpmc_ringbuf_reserve()
+ * @param rb The handle for the ring buffer
+ * @param ticket The ticket returned by metal_mpmc_ringbuf_reserve()
+ */
+void metal_mpmc_ringbuf_commit(struct metal_mpmc_ringbuf *rb, unsigned int ticket);
+
+/*!
+ * @brief Claim the element at the front of a ring buffer without copying it
+ * @param rb The handle for the ring buffer
+ * @param ticket Set to the ticket to pass to metal_mpmc_ringbuf_consume()
+ * @return A pointer to the element, or NULL if the ring buffer is empty
+ */
+void *metal_mpmc_ringbuf_peek(struct metal_mpmc_ringbuf *rb, unsigned int *ticket);
+
+/*!
+ * @brief Release an element claimed with metal_mpmc_ringbuf_peek()
+ * @param rb The handle for the ring buffer
+ * @param ticket The ticket returned by metal_mpmc_ringbuf_peek()
+ */
+void metal_mpmc_ringbuf_consume(struct metal_mpmc_ringbuf *rb, unsigned int ticket);
+
+#endif /* METAL__RINGBUF_H */
@@ -0,0 +1,211 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef METAL__SCHED_H
+#define METAL__SCHED_H
+
+#include <stddef.h>
+#include <metal/swtimer.h>
+
+/*!
+ * @file sched.h
+ * @brief API for a preemptive priority scheduler
+ *
+ * Unlike the cooperative tasks in task.h, these tasks are preempted as soon
+ * as a higher priority task becomes ready, from an interrupt handler or from
+ * another hart, and tasks of equal priority share the hart in time slices.
+ * Each hart runs its own tasks, and a task always runs on the hart it was
+ * created for.
+ *
+ * metal_sched_start() takes over the hart's trap vector with an entry which
+ * saves the whole register context on the interrupted task's stack, calls the
+ * usual interrupt and exception handlers, and then switches to another task if
+ * one should run. Only the direct (non-vectored) CLINT mode is supported.
+ * Floating point registers are only saved when a task has changed them, and
+ * interrupt handlers must not use floating point.
+ *
+ * Tasks wake up from sleeps through software timers (see swtimer.h), and the
+ * time slice is a software timer too. Waking a task on another hart sends it
+ * a software interrupt.
+ *
+ * Build with METAL_LOCK_PRIORITY_INHERIT to make a task which holds a
+ * metal_lock inherit the priority of any higher priority task waiting for it.
+ */
+
+/*!
+ * @def METAL_SCHED_PRIORITIES
+ * @brief The number of task priorities, at most 32
+ *
+ * Priority 0 is the lowest. The hart idles when no task is ready.
+ */
+#ifndef METAL_SCHED_PRIORITIES
+#define METAL_SCHED_PRIORITIES 32
+#endif
+
+/*!
+ * @def METAL_SCHED_SLICE_TICKS
+ * @brief The length of a time slice in mtime ticks
+ */
+#ifndef METAL_SCHED_SLICE_TICKS
+#define METAL_SCHED_SLICE_TICKS 1000
+#endif
+
+/*!
+ * @def METAL_SCHED_STACK_FILL
+ * @brief The word which unused task stack is filled with
+ *
+ * Used to measure how deep each task's stack has grown, and to detect stack
+ * overflow in the guard band when the task is switched out.
+ */
+#ifndef METAL_SCHED_STACK_FILL
+#define METAL_SCHED_STACK_FILL 0x5AA5C33CUL
+#endif
+
+/*!
+ * @def METAL_SCHED_STACK_GUARD
+ * @brief The number of bytes at the bottom of each task stack checked for
+ * overflow
+ *
+ * A task which writes any of these bytes, or whose stack pointer comes within
+ * one trap frame of the bottom of its stack, has overflowed. Must be a
+ * multiple of 4 and no larger than a trap frame, 32 registers.
+ */
+#ifndef METAL_SCHED_STACK_GUARD
+#define METAL_SCHED_STACK_GUARD 16
+#endif
+
+/*!
+ * @brief The function which a task runs
+ * @param arg The argument given to metal_sched_task_init()
+ *
+ * The task exits when the function returns.
+ */
+typedef void (*metal_sched_fn)(void *arg);
+
+/*!
+ * @brief A handle for a preemptive task
+ */
+struct metal_sched_task {
+    /* The trap frame saved when the task was switched out */
+    void *_sp;
+    /* Links the task into its hart's ready queue */
+    struct metal_sched_task *_next;
+    struct metal_sched_task *_prev;
+    struct metal_swtimer _timer;
+    unsigned char *_stack;
+    size_t _stack_size;
+    int _state;
+    /* The effective priority, which may be raised while holding a lock */
+    int _prio;
+    int _base_prio;
+    int _hartid;
+    int _locks_held;
+    /* A resume arrived while the task was still running */
+    int _resume_pending;
+    /* Resumed from another hart, so its hart must cancel its sleep timer */
+    int _cancel_pending;
+#ifdef __riscv_flen
+    int _fp_valid;
+    /* f0-f31 and fcsr */
+    unsigned long long _fp[33];
+#endif
+};
+
+/*!
+ * @brief Create a task
+ * @param task The handle for the task
+ * @param fn The function for the task to run
+ * @param arg The argument to pass to fn
+ * @param priority The priority of the task, from 0 to METAL_SCHED_PRIORITIES - 1
+ * @param stack The memory to use as the task's stack
+ * @param stack_size The size of the stack in bytes
+ * @param hartid The hart to run the task on
+ * @return 0 upon success
+ *
+ * The task is ready to run as soon as it is created. The stack must also have
+ * room for a trap frame and the deepest interrupt handler.
+ */
+int metal_sched_task_init(struct metal_sched_task *task, metal_sched_fn fn,
+                          void *arg, int priority, void *stack,
+                          size_t stack_size, int hartid);
+
+/*!
+ * @brief Start scheduling tasks on the current hart
+ *
+ * Installs the scheduler's trap entry, enables software timers, the software
+ * interrupt and machine interrupts, and switches to the highest priority
+ * ready task. The caller becomes the hart's idle loop, so this never returns.
+ * If the scheduler can't be started, the hart just idles.
+ */
+void metal_sched_start(void) __attribute__((noreturn));
+
+/*!
+ * @brief Get the task running on the current hart
+ * @return The current task, or NULL when not called from a task
+ */
+struct metal_sched_task *metal_sched_self(void);
+
+/*!
+ * @brief Let other ready tasks of the same or higher priority run
+ */
+void metal_sched_yield(void);
+
+/*!
+ * @brief Block the current task until a deadline
+ * @param deadline The value of mtime to wake up at
+ * @return 0 upon success, or -1 if not called from a task
+ */
+int metal_sched_sleep_until(unsigned long long deadline);
+
+/*!
+ * @brief Block the current task until another task or interrupt resumes it
+ *
+ * Returns immediately if the task was resumed since it last suspended.
+ */
+void metal_sched_suspend(void);
+
+/*!
+ * @brief Make a suspended or sleeping task ready to run
+ * @param task The handle for the task
+ * @return 0 upon success
+ *
+ * May be called from any hart, and from interrupt handlers.
+ */
+int metal_sched_resume(struct metal_sched_task *task);
+
+/*!
+ * @brief Change the priority of a task
+ * @param task The handle for the task
+ * @param priority The new priority
+ * @return 0 upon success
+ *
+ * A task holding a lock keeps any higher priority it has inherited until it
+ * gives the lock back.
+ */
+int metal_sched_set_priority(struct metal_sched_task *task, int priority);
+
+/*!
+ * @brief End the current task
+ *
+ * Equivalent to returning from the task's function.
+ */
+void metal_sched_exit(void) __attribute__((noreturn));
+
+/*!
+ * @brief Measure a task's stack watermark
+ * @param task The handle for the task
+ * @return The number of bytes at the bottom of the stack which have never been
+ * used
+ */
+size_t metal_sched_stack_unused(struct metal_sched_task *task);
+
+/*!
+ * @brief Called when a task has overflowed its stack
+ * @param task The task which overflowed
+ *
+ * Checked each time the task is switched out. The default implementation
+ * shuts down; it can be redefined.
+ */
+void metal_sched_stack_overflow(struct metal_sched_task *task);
+
+#endif /* METAL__SCHED_H */
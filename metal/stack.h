@@ -0,0 +1,78 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef METAL__STACK_H
+#define METAL__STACK_H
+
+#include <stdint.h>
+#include <metal/machine.h>
+
+/*!
+ * @file stack.h
+ * @brief API for configuring the harts' stacks
+ *
+ * The linker script reserves __stack_size bytes of stack for each hart,
+ * with hart 0's ending at _sp and each other hart's above the last. crt0
+ * carves the hart-local block (see hart_local.h) out of the top of each
+ * stack.
+ *
+ * A program can instead give each hart its own stack size with
+ * METAL_STACK_SIZES. The stacks are then packed upwards from the bottom of
+ * hart 0's, so the sizes must add up to no more than __stack_size times the
+ * number of harts.
+ *
+ * A program can also have each hart place a guard region at the bottom of its
+ * stack with METAL_STACK_GUARD, so an overflow raises an access fault instead
+ * of overwriting the stack below. The guard uses the last PMP region of each
+ * hart, which is locked until reset so that it also applies in machine mode.
+ * It has no effect where a lower numbered PMP region covers the same memory.
+ */
+
+/*!
+ * @def METAL_STACK_SIZES
+ * @brief Set the size of each hart's stack
+ *
+ * Use once at file scope in any source file of the program, with one size per
+ * hart in order of hart ID, for example:
+ *
+ *     METAL_STACK_SIZES(8192, 1024, 1024, 1024);
+ *
+ * A size of 0 stands for __stack_size. Sizes should be multiples of 16. The
+ * program shuts down before main() is called if the sizes add up to more
+ * than the linker script reserved.
+ */
+#define METAL_STACK_SIZES(...) \
+		const unsigned long __metal_stack_sizes[__METAL_DT_MAX_HARTS] = \
+			{ __VA_ARGS__ }; \
+		extern void __metal_stack_sizes_check(void); \
+		static void (*const _metal_stack_sizes_ref)(void) \
+			__attribute__((used)) = __metal_stack_sizes_check
+
+/*!
+ * @def METAL_STACK_GUARD
+ * @brief Guard the bottom of each hart's stack with a PMP region
+ *
+ * Use once at file scope in any source file of the program. size is a power
+ * of two no smaller than the PMP granularity, and the guard takes the lowest
+ * size-aligned size bytes of each stack. Each hart sets up its guard just
+ * before calling main() or secondary_main().
+ */
+#define METAL_STACK_GUARD(size) \
+		const unsigned long __metal_stack_guard_size = (size); \
+		extern void __metal_stack_guard_init(void); \
+		static void (*const _metal_stack_guard_ref)(void) \
+			__attribute__((used)) = __metal_stack_guard_init
+
+/*!
+ * @brief Get the bounds of a hart's stack
+ * @param hartid The hart ID
+ * @param bottom Set to the lowest address of the stack
+ * @param top Set to the address just above the stack
+ * @return 0 upon success, or -1 if hartid is out of range
+ *
+ * The bounds are those reserved for the stack, including any hart-local
+ * block and guard region.
+ */
+int metal_stack_get_bounds(int hartid, uintptr_t *bottom, uintptr_t *top);
+
+#endif
@@ -0,0 +1,124 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef METAL__SWTIMER_H
+#define METAL__SWTIMER_H
+
+/*!
+ * @file swtimer.h
+ * @brief API for many software timers sharing the machine timer
+ *
+ * Each hart keeps a hierarchical timer wheel of software timers. Starting and
+ * cancelling a timer takes constant time no matter how many timers are
+ * pending. Only the earliest expiry is programmed into the hart's mtimecmp
+ * register, and expired timers call their callbacks from the timer interrupt.
+ *
+ * A timer belongs to the hart which started it, and must only be started or
+ * cancelled from that hart.
+ */
+
+/*!
+ * @def METAL_SWTIMER_LEVELS
+ * @brief The number of levels in each timer wheel
+ *
+ * Each level has 64 slots, each 64 times wider than the slots of the level
+ * below. Timers further in the future than the wheel covers are parked in the
+ * last slot and moved down when it is reached.
+ */
+#ifndef METAL_SWTIMER_LEVELS
+#define METAL_SWTIMER_LEVELS 4
+#endif
+
+/*!
+ * @def METAL_SWTIMER_SHIFT
+ * @brief The log2 of the number of mtime ticks in one timer wheel tick
+ *
+ * Timers never expire early, but may expire up to 2^METAL_SWTIMER_SHIFT mtime
+ * ticks late. Coarser ticks let the wheel cover a longer time.
+ */
+#ifndef METAL_SWTIMER_SHIFT
+#define METAL_SWTIMER_SHIFT 0
+#endif
+
+struct metal_swtimer;
+
+/*!
+ * @brief The function called when a software timer expires
+ * @param timer The timer which expired
+ * @param arg The argument given to metal_swtimer_init()
+ *
+ * Called from the timer interrupt. The timer may be restarted from here.
+ */
+typedef void (*metal_swtimer_callback)(struct metal_swtimer *timer, void *arg);
+
+/*!
+ * @brief A handle for a software timer
+ */
+struct metal_swtimer {
+    struct metal_swtimer *_next;
+    struct metal_swtimer **_pprev;
+    /* The expiry time in mtime ticks */
+    unsigned long long _expires;
+    metal_swtimer_callback _callback;
+    void *_arg;
+    int _hartid;
+};
+
+/*!
+ * @brief Enable software timers on the current hart
+ * @return 0 upon success
+ *
+ * Registers the timer wheel as the handler for the hart's timer interrupt and
+ * enables it. Machine interrupts must also be enabled on the CPU interrupt
+ * controller for callbacks to run.
+ */
+int metal_swtimer_enable(void);
+
+/*!
+ * @brief Initialize a software timer
+ * @param timer The handle for the timer
+ * @param callback The function to call when the timer expires
+ * @param arg The argument to pass to the callback
+ */
+void metal_swtimer_init(struct metal_swtimer *timer,
+                        metal_swtimer_callback callback, void *arg);
+
+/*!
+ * @brief Start a software timer
+ * @param timer The handle for the timer
+ * @param expires The value of mtime at which the timer expires
+ * @return 0 upon success
+ *
+ * A timer which is already pending is moved to the new expiry time. A time in
+ * the past expires on the next timer interrupt.
+ */
+int metal_swtimer_start(struct metal_swtimer *timer, unsigned long long expires);
+
+/*!
+ * @brief Cancel a software timer
+ * @param timer The handle for the timer
+ * @return 1 if the timer was pending, 0 if it was not
+ */
+int metal_swtimer_cancel(struct metal_swtimer *timer);
+
+/*!
+ * @brief Check whether a software timer is pending
+ * @param timer The handle for the timer
+ * @return 1 if the timer has been started and has not expired or been
+ * cancelled
+ */
+__inline__ int metal_swtimer_pending(struct metal_swtimer *timer) {
+    return timer->_pprev != 0;
+}
+
+/*!
+ * @brief Get the time of the next software timer event on the current hart
+ * @return The value of mtime at which the timer wheel next needs attention, or
+ * ULLONG_MAX if no timers are pending
+ *
+ * This may be earlier than the expiry of any timer when pending timers need to
+ * be moved to a finer level of the wheel.
+ */
+unsigned long long metal_swtimer_next_event(void);
+
+#endif /* METAL__SWTIMER_H */
@@ -0,0 +1,169 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef METAL__TASK_H
+#define METAL__TASK_H
+
+#include <stddef.h>
+#include <metal/swtimer.h>
+
+/*!
+ * @file task.h
+ * @brief API for cooperative tasks
+ *
+ * Tasks are lightweight threads, each with its own stack, which run until
+ * they yield, sleep or wait on an event. Each hart has its own run queue, and
+ * a task always runs on the hart which created it. Switching tasks only saves
+ * the registers which a function call must preserve, so it costs about as
+ * much as a function call and return.
+ *
+ * Sleeping tasks are woken by software timers (see swtimer.h), so
+ * metal_swtimer_enable() must be called on the hart before any task sleeps or
+ * waits with a timeout. Events can be signalled from interrupt handlers.
+ */
+
+/*!
+ * @def METAL_TASK_MIN_STACK
+ * @brief The smallest stack, in bytes, which metal_task_init() accepts
+ */
+#ifndef METAL_TASK_MIN_STACK
+#define METAL_TASK_MIN_STACK 256
+#endif
+
+/*!
+ * @brief The function which a task runs
+ * @param arg The argument given to metal_task_init()
+ *
+ * The task exits when the function returns.
+ */
+typedef void (*metal_task_fn)(void *arg);
+
+struct metal_event;
+
+/*!
+ * @brief A handle for a task
+ */
+struct metal_task {
+    /* The stack pointer saved when the task was switched out */
+    void *_sp;
+    /* Links the task into its run queue or the waiters of an event */
+    struct metal_task *_next;
+    struct metal_task **_pprev;
+    /* The event the task is waiting on, if any */
+    struct metal_event *_waiting;
+    struct metal_swtimer _timer;
+    metal_task_fn _fn;
+    void *_arg;
+    int _state;
+    int _timed_out;
+    int _hartid;
+};
+
+/*!
+ * @brief A handle for an event which tasks can wait on
+ *
+ * Signalling an event wakes all the tasks waiting on it. If none are, the
+ * signal is remembered and the next wait returns immediately.
+ */
+struct metal_event {
+    struct metal_task *_waiters;
+    int _pending;
+};
+
+/*!
+ * @brief Create a task on the current hart
+ * @param task The handle for the task
+ * @param fn The function for the task to run
+ * @param arg The argument to pass to fn
+ * @param stack The memory to use as the task's stack
+ * @param stack_size The size of the stack in bytes
+ * @return 0 upon success
+ *
+ * The task is ready to run as soon as it is created, and first runs when the
+ * current task yields or blocks, or when metal_task_run() is called.
+ */
+int metal_task_init(struct metal_task *task, metal_task_fn fn, void *arg,
+                    void *stack, size_t stack_size);
+
+/*!
+ * @brief Run the current hart's tasks
+ * @return 0 once all the hart's tasks have exited, or -1 if called from a task
+ *
+ * When no task is ready the hart idles (see idle.h) until an interrupt wakes
+ * one up.
+ */
+int metal_task_run(void);
+
+/*!
+ * @brief Get the task running on the current hart
+ * @return The current task, or NULL when not called from a task
+ */
+struct metal_task *metal_task_self(void);
+
+/*!
+ * @brief Let the other ready tasks on the current hart run
+ *
+ * Returns immediately if no other task is ready.
+ */
+void metal_task_yield(void);
+
+/*!
+ * @brief Block the current task until a deadline
+ * @param deadline The value of mtime to wake up at
+ * @return 0 upon success, or -1 if not called from a task or software timers
+ * are not enabled
+ */
+int metal_task_sleep_until(unsigned long long deadline);
+
+/*!
+ * @brief End the current task
+ *
+ * Equivalent to returning from the task's function.
+ */
+void metal_task_exit(void) __attribute__((noreturn));
+
+/*!
+ * @brief Initialize an event
+ * @param event The handle for the event
+ */
+void metal_event_init(struct metal_event *event);
+
+/*!
+ * @brief Block the current task until an event is signalled
+ * @param event The handle for the event
+ * @return 0 upon success, or -1 if not called from a task
+ */
+int metal_event_wait(struct metal_event *event);
+
+/*!
+ * @brief Block the current task until an event is signalled or a deadline
+ * @param event The handle for the event
+ * @param deadline The value of mtime at which to give up
+ * @return 0 if the event was signalled, 1 if the deadline passed, or -1 if not
+ * called from a task or software timers are not enabled
+ */
+int metal_event_wait_until(struct metal_event *event,
+                           unsigned long long deadline);
+
+/*!
+ * @brief Signal an event
+ * @param event The handle for the event
+ *
+ * May be called from an interrupt handler. The waiting tasks must run on the
+ * current hart.
+ */
+void metal_event_signal(struct metal_event *event);
+
+/*!
+ * @brief An interrupt handler which signals an event
+ * @param id The interrupt ID
+ * @param event The event to signal
+ *
+ * Can be passed directly to metal_interrupt_register_handler() with the event
+ * as the private data, so a task can wait for an interrupt. The handler does
+ * not quiet the interrupt source, so it suits sources which only fire once per
+ * request, such as a transfer completing.
+ */
+void metal_event_isr(int id, void *event);
+
+#endif /* METAL__TASK_H */
@@ -4,11 +4,73 @@
 #ifndef METAL__TIMER_H
 #define METAL__TIMER_H
 
+#include <metal/io.h>
+
+#ifdef __ICCRISCV__
+#define __asm__ asm
+#endif
+
 /*!
  * @file timer.h
  * @brief API for reading and manipulating the machine timer
  */
 
+/* The address of mtime in the CLINT or CLIC, resolved at startup */
+extern unsigned long __metal_mtime_address;
+unsigned long long __metal_mtime_read_slow(void);
+/* Returns 0 if mtime can be read and the timebase is known */
+int __metal_mtime_check(void);
+
+/*!
+ * @brief Read the mtime real-time clock
+ * @return The current value of mtime
+ *
+ * The address of mtime is looked up once at startup, so this is a plain load
+ * (two or three on RV32) rather than a call through the CPU and interrupt
+ * controller drivers, and it does not need the interrupt controller to be
+ * initialized. Define METAL_MTIME_USE_RDTIME on targets which implement the
+ * time CSR to read it instead.
+ */
+__inline__ unsigned long long metal_mtime_read(void)
+{
+#if defined(METAL_MTIME_USE_RDTIME)
+#if __riscv_xlen == 32
+    unsigned long hi, hi1, lo;
+
+    do {
+        __asm__ volatile ("rdtimeh %0" : "=r"(hi));
+        __asm__ volatile ("rdtime %0" : "=r"(lo));
+        __asm__ volatile ("rdtimeh %0" : "=r"(hi1));
+    } while (hi != hi1);
+
+    return ((unsigned long long)hi << 32) | lo;
+#else
+    unsigned long long time;
+    __asm__ volatile ("rdtime %0" : "=r"(time));
+    return time;
+#endif
+#else
+    unsigned long mtime = __metal_mtime_address;
+
+    if (!mtime) {
+        return __metal_mtime_read_slow();
+    }
+#if __riscv_xlen == 32
+    __metal_io_u32 hi, lo;
+
+    /* Guard against rollover when reading */
+    do {
+        hi = __METAL_ACCESS_ONCE((__metal_io_u32 *)(mtime + 4));
+        lo = __METAL_ACCESS_ONCE((__metal_io_u32 *)mtime);
+    } while (__METAL_ACCESS_ONCE((__metal_io_u32 *)(mtime + 4)) != hi);
+
+    return (((unsigned long long)hi) << 32) | lo;
+#else
+    return __METAL_ACCESS_ONCE((__metal_io_u64 *)mtime);
+#endif
+#endif
+}
+
 /*!
  * @brief Read the machine cycle count
  * @param hartid The hart ID to read the cycle count of
@@ -25,6 +87,53 @@ int metal_timer_get_cyclecount(int hartid, unsigned long long *cyclecount);
  */
 int metal_timer_get_timebase_frequency(int hartid, unsigned long long *timebase);
 
+/*!
+ * @brief Read the machine time of a hart
+ * @param hartid The hart ID to read the machine time of
+ * @return The full 64-bit value of mtime, or 0 upon failure
+ *
+ * Goes through the hart's CPU driver, so the CPU interrupt controller must be
+ * initialized. metal_mtime_read() is faster and has no such requirement.
+ */
+unsigned long long metal_timer_get_machine_time(int hartid);
+
+/*!
+ * @brief Set the machine timer compare register of a hart
+ * @param hartid The hart ID to set the compare register of
+ * @param time The value of mtime at which the timer interrupt fires
+ * @return 0 upon success
+ */
+int metal_timer_set_machine_time(int hartid, unsigned long long time);
+
+/*!
+ * @brief Set the current hart's machine timer compare register
+ * @param time The value of mtime at which the timer interrupt fires
+ * @return 0 upon success
+ *
+ * Writes the CLINT or CLIC directly, without going through the CPU driver.
+ * On RV32 the high word is parked at its maximum while the low word is
+ * written, so no spurious interrupt can fire in between.
+ */
+int metal_timer_set_compare(unsigned long long time);
+
+/*!
+ * @brief Set the current hart's timer interrupt to fire after a delay
+ * @param ticks The delay in timebase ticks
+ * @param deadline If not NULL, set to the absolute deadline
+ * @return 0 upon success
+ */
+int metal_timer_set_timeout(unsigned long long ticks, unsigned long long *deadline);
+
+/*!
+ * @brief Check whether a deadline has passed
+ * @param deadline An absolute value of mtime
+ * @return 1 if mtime has reached the deadline, 0 otherwise
+ */
+__inline__ int metal_timer_deadline_passed(unsigned long long deadline)
+{
+    return metal_mtime_read() >= deadline;
+}
+
 /*! 
  * @brief Set the machine timer tick interval in seconds
  * @param hartid The hart ID to read the timebase of
@@ -33,4 +142,52 @@ int metal_timer_get_timebase_frequency(int hartid, unsigned long long *timebase)
  */
 int metal_timer_set_tick(int hartid, int second);
 
+/* A conversion factor, x * num / den == (x * mult) >> shift */
+struct __metal_timer_scale {
+    unsigned long long mult;
+    unsigned int shift;
+};
+
+void __metal_timer_scale_init(struct __metal_timer_scale *scale,
+                              unsigned long long num,
+                              unsigned long long den);
+unsigned long long __metal_timer_mul_shr(unsigned long long a,
+                                         unsigned long long b,
+                                         unsigned int shift);
+
+/*!
+ * @brief Convert timebase ticks to nanoseconds
+ * @param ticks A number of timebase ticks
+ * @return The number of nanoseconds, rounded down
+ *
+ * The conversions between ticks and other units use a multiplier and shift
+ * computed from the timebase frequency on first use, so they never divide.
+ * They return 0 if the machine has no timebase.
+ */
+unsigned long long metal_timer_ticks_to_ns(unsigned long long ticks);
+
+/*!
+ * @brief Convert timebase ticks to microseconds
+ * @param ticks A number of timebase ticks
+ * @return The number of microseconds, rounded down
+ */
+unsigned long long metal_timer_ticks_to_us(unsigned long long ticks);
+
+/*!
+ * @brief Split timebase ticks into whole seconds and remaining ticks
+ * @param ticks A number of timebase ticks
+ * @param remainder Set to the ticks left over after the whole seconds
+ * @return The number of whole seconds
+ */
+unsigned long long metal_timer_ticks_to_sec(unsigned long long ticks,
+                                            unsigned long long *remainder);
+
+/*!
+ * @brief Convert nanoseconds to timebase ticks
+ * @param ns A number of nanoseconds
+ * @return The number of ticks, rounded up so that waiting that many ticks
+ * never waits less than ns, or ULLONG_MAX if that doesn't fit
+ */
+unsigned long long metal_timer_ns_to_ticks(unsigned long long ns);
+
 #endif
@@ -0,0 +1,7 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <metal/barrier.h>
+
+extern __inline__ int metal_barrier_init(struct metal_barrier *barrier, int harts);
+extern __inline__ int metal_barrier_wait(struct metal_barrier *barrier);
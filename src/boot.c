@@ -0,0 +1,13 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <metal/machine.h>
+#include <metal/boot.h>
+
+/* Written by crt0 after the BSS is zeroed, see gloss/crt0.S */
+unsigned long __metal_boot_enter_cycle;
+
+unsigned long metal_boot_cycles(void)
+{
+    return (unsigned long)__metal_mcycle_read() - __metal_boot_enter_cycle;
+}
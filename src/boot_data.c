@@ -0,0 +1,149 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <metal/boot.h>
+
+extern unsigned char metal_segment_data_source_start[];
+extern unsigned char metal_segment_data_target_start[];
+extern unsigned char metal_segment_data_target_end[];
+
+/* The header scripts/compress-data puts in front of the compressed image */
+struct _metal_boot_data_header {
+    uint32_t magic;
+    /* The size of .data in RAM */
+    uint32_t size;
+    /* The size of the LZ4 block which follows */
+    uint32_t packed_size;
+    uint32_t reserved;
+};
+
+/* "MLZ4" */
+#define _METAL_BOOT_DATA_MAGIC 0x345a4c4d
+
+/*
+ * Everything here runs before the data section is valid and the BSS is
+ * zeroed, so it may only use the stack.
+ */
+
+/* Called by crt0.S and the parallel boot to see whether the load image of
+ * .data needs decompressing rather than copying */
+__attribute__((section(".init")))
+int __metal_boot_data_compressed(void)
+{
+    const struct _metal_boot_data_header *header =
+        (const struct _metal_boot_data_header *)metal_segment_data_source_start;
+
+    if ((uintptr_t)metal_segment_data_source_start ==
+        (uintptr_t)metal_segment_data_target_start) {
+        return 0;
+    }
+    return header->magic == _METAL_BOOT_DATA_MAGIC &&
+           header->size == (uint32_t)(metal_segment_data_target_end -
+                                      metal_segment_data_target_start);
+}
+
+/* Copy len bytes, a word at a time once the output is word aligned. The
+ * source needn't be aligned: each word is put together from the two aligned
+ * words which hold it, both read afresh, so a source a word or more behind
+ * the output sees the words just written. Returns the end of the output. */
+__attribute__((section(".init")))
+static unsigned char *_metal_boot_data_copy(unsigned char *out,
+                                            const unsigned char *src, size_t len)
+{
+    const unsigned long *word;
+    unsigned int shift;
+
+    while (len && ((uintptr_t)out & (sizeof(unsigned long) - 1))) {
+        *out++ = *src++;
+        len--;
+    }
+
+    shift = ((uintptr_t)src & (sizeof(unsigned long) - 1)) * 8;
+    while (len >= sizeof(unsigned long)) {
+        word = (const unsigned long *)((uintptr_t)src & ~(sizeof(unsigned long) - 1));
+        if (shift) {
+            *(unsigned long *)out = (word[0] >> shift) |
+                                    (word[1] << (8 * sizeof(unsigned long) - shift));
+        } else {
+            *(unsigned long *)out = word[0];
+        }
+        out += sizeof(unsigned long);
+        src += sizeof(unsigned long);
+        len -= sizeof(unsigned long);
+    }
+
+    while (len--) {
+        *out++ = *src++;
+    }
+    return out;
+}
+
+/* Decode an LZ4 block. Stops early rather than overrun the output if the
+ * input is corrupt. */
+__attribute__((section(".init")))
+static void _metal_boot_data_lz4(const unsigned char *in, const unsigned char *in_end,
+                                 unsigned char *out, unsigned char *out_end)
+{
+    while (in < in_end) {
+        unsigned int token = *in++;
+        size_t len = token >> 4;
+        const unsigned char *match;
+
+        if (len == 15) {
+            unsigned int more;
+            do {
+                more = *in++;
+                len += more;
+            } while (more == 255 && in < in_end);
+        }
+        if (len > (size_t)(out_end - out) || len > (size_t)(in_end - in)) {
+            return;
+        }
+        out = _metal_boot_data_copy(out, in, len);
+        in += len;
+
+        /* The last sequence is literals only */
+        if (in_end - in < 2) {
+            return;
+        }
+        match = out - (in[0] | (in[1] << 8));
+        in += 2;
+
+        len = token & 0xf;
+        if (len == 15) {
+            unsigned int more;
+            do {
+                more = *in++;
+                len += more;
+            } while (more == 255 && in < in_end);
+        }
+        len += 4;
+        if (match < metal_segment_data_target_start || match >= out ||
+            len > (size_t)(out_end - out)) {
+            return;
+        }
+        if (out - match >= (ptrdiff_t)sizeof(unsigned long)) {
+            out = _metal_boot_data_copy(out, match, len);
+        } else {
+            /* Byte by byte, since each word would overlap what it produces */
+            while (len--) {
+                *out++ = *match++;
+            }
+        }
+    }
+}
+
+/* Called by crt0.S in place of copying .data when the image is compressed */
+__attribute__((section(".init")))
+void __metal_boot_data_decompress(void)
+{
+    const struct _metal_boot_data_header *header =
+        (const struct _metal_boot_data_header *)metal_segment_data_source_start;
+    const unsigned char *in = (const unsigned char *)(header + 1);
+
+    _metal_boot_data_lz4(in, in + header->packed_size,
+                         metal_segment_data_target_start,
+                         metal_segment_data_target_end);
+}
@@ -0,0 +1,156 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <stdint.h>
+#include <metal/machine.h>
+#include <metal/boot.h>
+
+extern unsigned long metal_segment_data_source_start[];
+extern unsigned long metal_segment_data_target_start[];
+extern unsigned long metal_segment_data_target_end[];
+extern unsigned long metal_segment_itim_source_start[];
+extern unsigned long metal_segment_itim_target_start[];
+extern unsigned long metal_segment_itim_target_end[];
+extern unsigned long metal_segment_bss_target_start[];
+extern unsigned long metal_segment_bss_target_end[];
+/* Only present when the linker script places the DTIM sections */
+extern unsigned long metal_segment_dtim_source_start[] __attribute__((weak));
+extern unsigned long metal_segment_dtim_target_start[] __attribute__((weak));
+extern unsigned long metal_segment_dtim_target_end[] __attribute__((weak));
+extern unsigned long metal_segment_dtim_bss_target_start[] __attribute__((weak));
+extern unsigned long metal_segment_dtim_bss_target_end[] __attribute__((weak));
+
+void __metal_synchronize_harts();
+/* Defined when the .data image may be compressed, see boot_data.c */
+int __metal_boot_data_compressed(void) __attribute__((weak));
+void __metal_boot_data_decompress(void) __attribute__((weak));
+extern char __metal_boot_hart;
+
+/* Slices meet on cache line boundaries, so no two harts write the same line */
+#define _METAL_BOOT_SLICE_ALIGN 64
+
+/*
+ * Everything here runs before the data section is valid and the BSS is
+ * zeroed, so it may only use the stack.
+ */
+
+/* Find this hart's slice of [*start, *end). Returns 0 if it's empty. */
+__attribute__((section(".init")))
+static int _metal_boot_slice(int hartid, unsigned long **start,
+                             unsigned long **end)
+{
+    uintptr_t base = (uintptr_t)*start;
+    uintptr_t limit = (uintptr_t)*end;
+    uintptr_t mask = _METAL_BOOT_SLICE_ALIGN - 1;
+    uintptr_t per, lo, hi;
+
+    if (base >= limit || hartid >= __METAL_DT_MAX_HARTS) {
+        return 0;
+    }
+
+    per = (limit - base + __METAL_DT_MAX_HARTS - 1) / __METAL_DT_MAX_HARTS;
+
+    /* Round the boundaries between slices up to absolute line addresses. The
+     * segment itself needn't start or end on one, so the first and last
+     * slices take the partial lines. */
+    lo = base;
+    if (hartid) {
+        lo = (base + per * hartid + mask) & ~mask;
+    }
+    hi = (base + per * (hartid + 1) + mask) & ~mask;
+    if (hi > limit) {
+        hi = limit;
+    }
+    if (lo >= hi) {
+        return 0;
+    }
+
+    *start = (unsigned long *)lo;
+    *end = (unsigned long *)hi;
+    return 1;
+}
+
+__attribute__((section(".init")))
+static void _metal_boot_copy(int hartid, unsigned long *src,
+                             unsigned long *dst, unsigned long *end)
+{
+    unsigned long *slice = dst;
+
+    if (src == dst || !_metal_boot_slice(hartid, &slice, &end)) {
+        return;
+    }
+    src += slice - dst;
+
+    while (end - slice >= 4) {
+        unsigned long w0 = src[0], w1 = src[1], w2 = src[2], w3 = src[3];
+
+        slice[0] = w0;
+        slice[1] = w1;
+        slice[2] = w2;
+        slice[3] = w3;
+        src += 4;
+        slice += 4;
+    }
+    while (slice < end) {
+        *slice++ = *src++;
+    }
+}
+
+__attribute__((section(".init")))
+static void _metal_boot_zero(int hartid, unsigned long *start,
+                             unsigned long *end)
+{
+    if (!_metal_boot_slice(hartid, &start, &end)) {
+        return;
+    }
+
+    while (end - start >= 8) {
+        start[0] = 0;
+        start[1] = 0;
+        start[2] = 0;
+        start[3] = 0;
+        start[4] = 0;
+        start[5] = 0;
+        start[6] = 0;
+        start[7] = 0;
+        start += 8;
+    }
+    while (start < end) {
+        *start++ = 0;
+    }
+}
+
+/*
+ * Called by crt0.S on every hart, in place of the boot hart copying and
+ * zeroing memory alone.
+ */
+__attribute__((section(".init")))
+void __metal_boot_parallel(int hartid)
+{
+    /* A compressed image can't be split, so the boot hart decompresses all
+     * of it while the others get on with the rest */
+    if (__metal_boot_data_compressed && __metal_boot_data_compressed()) {
+        if (hartid == (int)(uintptr_t)&__metal_boot_hart) {
+            __metal_boot_data_decompress();
+        }
+    } else {
+        _metal_boot_copy(hartid, metal_segment_data_source_start,
+                         metal_segment_data_target_start,
+                         metal_segment_data_target_end);
+    }
+    _metal_boot_copy(hartid, metal_segment_itim_source_start,
+                     metal_segment_itim_target_start,
+                     metal_segment_itim_target_end);
+    _metal_boot_copy(hartid, metal_segment_dtim_source_start,
+                     metal_segment_dtim_target_start,
+                     metal_segment_dtim_target_end);
+    _metal_boot_zero(hartid, metal_segment_bss_target_start,
+                     metal_segment_bss_target_end);
+    _metal_boot_zero(hartid, metal_segment_dtim_bss_target_start,
+                     metal_segment_dtim_bss_target_end);
+
+    /* Make this hart's stores visible before the others are let go */
+    __asm__ volatile("fence w,rw" ::: "memory");
+
+    __metal_synchronize_harts();
+}
@@ -0,0 +1,147 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <stdint.h>
+#include <metal/boot.h>
+#include <metal/drivers/riscv_cpu.h>
+#include <metal/tty.h>
+
+extern char __metal_boot_hart;
+
+/* From the linker script, as used by __libc_init_array() */
+extern void (*__preinit_array_start[])(void) __attribute__((weak));
+extern void (*__preinit_array_end[])(void) __attribute__((weak));
+extern void (*__init_array_start[])(void) __attribute__((weak));
+extern void (*__init_array_end[])(void) __attribute__((weak));
+extern void _init(void);
+
+struct metal_boot_profile metal_boot_profile;
+
+static void _metal_boot_profile_run(void (*fn)(void))
+{
+    struct metal_boot_profile *profile = &metal_boot_profile;
+    unsigned long start = __metal_mcycle_read();
+
+    fn();
+
+    if (profile->constructor_count < METAL_BOOT_PROFILE_MAX_CONSTRUCTORS) {
+        struct metal_boot_profile_constructor *ctor =
+            &profile->constructors[profile->constructor_count];
+
+        ctor->fn = fn;
+        ctor->cycles = __metal_mcycle_read() - start;
+    }
+    profile->constructor_count++;
+}
+
+/* Called by crt0.S on the boot hart once memory is initialized. marks holds
+ * the cycle counts at the start of copying, zeroing and the end of zeroing. */
+void __metal_boot_profile_memory(unsigned long enter, unsigned long *marks)
+{
+    metal_boot_profile.enter = enter;
+    metal_boot_profile.copy_start = marks[0];
+    metal_boot_profile.zero_start = marks[1];
+    metal_boot_profile.zero_end = marks[2];
+}
+
+/* Called by crt0.S in place of __libc_init_array(), which it mirrors */
+void __metal_boot_profile_init_array(void)
+{
+    metal_boot_profile.constructors_start = __metal_mcycle_read();
+
+    for (void (**fn)(void) = __preinit_array_start; fn < __preinit_array_end; fn++) {
+        _metal_boot_profile_run(*fn);
+    }
+    _init();
+    for (void (**fn)(void) = __init_array_start; fn < __init_array_end; fn++) {
+        _metal_boot_profile_run(*fn);
+    }
+
+    metal_boot_profile.constructors_end = __metal_mcycle_read();
+}
+
+/* Called by crt0.S on every hart just before main() */
+void __metal_boot_profile_main(void)
+{
+    int hartid = __metal_current_hartid();
+    if (hartid == (int)(uintptr_t)&__metal_boot_hart) {
+        metal_boot_profile.main = __metal_mcycle_read();
+    }
+}
+
+static void _metal_boot_profile_puts(const char *s)
+{
+    while (*s) {
+        metal_tty_putc(*s++);
+    }
+}
+
+static void _metal_boot_profile_putu(unsigned long val)
+{
+    char buf[21];
+    int i = sizeof(buf) - 1;
+
+    buf[i] = '\0';
+    do {
+        buf[--i] = '0' + (val % 10);
+        val /= 10;
+    } while (val);
+
+    _metal_boot_profile_puts(&buf[i]);
+}
+
+static void _metal_boot_profile_putx(uintptr_t val)
+{
+    char buf[2 * sizeof(uintptr_t) + 3];
+    int i = sizeof(buf) - 1;
+
+    buf[i] = '\0';
+    do {
+        buf[--i] = "0123456789abcdef"[val & 0xf];
+        val >>= 4;
+    } while (val);
+    buf[--i] = 'x';
+    buf[--i] = '0';
+
+    _metal_boot_profile_puts(&buf[i]);
+}
+
+static void _metal_boot_profile_phase(const char *name, unsigned long from,
+                                      unsigned long to)
+{
+    _metal_boot_profile_puts(name);
+    _metal_boot_profile_puts("\t");
+    _metal_boot_profile_putu(to - from);
+    _metal_boot_profile_puts("\n");
+}
+
+void metal_boot_profile_dump(void)
+{
+    const struct metal_boot_profile *profile = &metal_boot_profile;
+    unsigned int count = profile->constructor_count;
+
+    if (count > METAL_BOOT_PROFILE_MAX_CONSTRUCTORS) {
+        count = METAL_BOOT_PROFILE_MAX_CONSTRUCTORS;
+    }
+
+    _metal_boot_profile_puts("phase\tcycles\n");
+    _metal_boot_profile_phase("enter", profile->enter, profile->copy_start);
+    _metal_boot_profile_phase("copy", profile->copy_start, profile->zero_start);
+    _metal_boot_profile_phase("zero", profile->zero_start, profile->zero_end);
+    _metal_boot_profile_phase("constructors", profile->constructors_start,
+                              profile->constructors_end);
+    _metal_boot_profile_phase("total", profile->enter, profile->main);
+
+    for (unsigned int i = 0; i < count; i++) {
+        _metal_boot_profile_puts("  ");
+        _metal_boot_profile_putx((uintptr_t)profile->constructors[i].fn);
+        _metal_boot_profile_puts("\t");
+        _metal_boot_profile_putu(profile->constructors[i].cycles);
+        _metal_boot_profile_puts("\n");
+    }
+    if (profile->constructor_count > count) {
+        _metal_boot_profile_puts("  (");
+        _metal_boot_profile_putu(profile->constructor_count - count);
+        _metal_boot_profile_puts(" more)\n");
+    }
+}
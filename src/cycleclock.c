@@ -0,0 +1,264 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <metal/machine.h>
+#include <metal/io.h>
+#include <metal/drivers/riscv_cpu.h>
+#include <metal/timer.h>
+#include <metal/cycleclock.h>
+
+struct _metal_cycleclock {
+    /* mcycle, mtime and mtime in nanoseconds at the last anchor */
+    unsigned long long cycle0;
+    unsigned long long tick0;
+    unsigned long long ns0;
+    /* Converts cycles since the anchor to nanoseconds */
+    struct __metal_timer_scale to_ns;
+    /* The number of cycles after which to re-anchor */
+    unsigned long long resync_cycles;
+    unsigned long long rate_hz;
+    unsigned long long last_ns;
+    unsigned int generation;
+    int valid;
+};
+
+static struct _metal_cycleclock _metal_cycleclocks[__METAL_DT_MAX_HARTS];
+
+/* The rate measured after the last rate change, which every hart adopts */
+static struct {
+    struct __metal_timer_scale to_ns;
+    unsigned long long resync_cycles;
+    unsigned long long rate_hz;
+} _metal_cycleclock_rate;
+
+/* Bumped whenever a tracked clock changes rate, after the new rate is
+ * published */
+static unsigned int _metal_cycleclock_generation = 0;
+
+static metal_clock_callback _metal_cycleclock_callbacks[METAL_CYCLECLOCK_MAX_CLOCKS];
+static int _metal_cycleclock_num_clocks = 0;
+
+static void _metal_cycleclock_set_rate(struct _metal_cycleclock *cc,
+                                       unsigned long long cycles,
+                                       unsigned long long ticks)
+{
+    unsigned long long ns = metal_timer_ticks_to_ns(ticks);
+    struct __metal_timer_scale scale;
+
+    if (cycles == 0 || ns == 0) {
+        return;
+    }
+
+    /* These divides only happen when calibrating or re-anchoring. The
+     * products go through a multiplier and shift, since cycles * 10^9 can
+     * overflow 64 bits. */
+    __metal_timer_scale_init(&cc->to_ns, ns, cycles);
+    __metal_timer_scale_init(&scale, 1000000000ULL, ns);
+    cc->rate_hz = __metal_timer_mul_shr(cycles, scale.mult, scale.shift);
+    __metal_timer_scale_init(&scale, METAL_CYCLECLOCK_RESYNC_TICKS, ticks);
+    cc->resync_cycles = __metal_timer_mul_shr(cycles, scale.mult, scale.shift);
+}
+
+static void _metal_cycleclock_anchor(struct _metal_cycleclock *cc,
+                                     unsigned long long cycle,
+                                     unsigned long long tick)
+{
+    cc->cycle0 = cycle;
+    cc->tick0 = tick;
+    cc->ns0 = metal_timer_ticks_to_ns(tick);
+}
+
+/* Busy-waits to measure the rate of this hart's mcycle */
+static int _metal_cycleclock_measure(struct _metal_cycleclock *cc)
+{
+    unsigned long long t, t0, t1, c0, c1;
+
+    /* Without mtime there is nothing to measure against, and the loops below
+     * would never end */
+    if (__metal_mtime_check()) {
+        return -1;
+    }
+
+    /* Measure between two edges of mtime, so its resolution doesn't matter */
+    t = metal_mtime_read();
+    while ((t0 = metal_mtime_read()) == t) ;
+    c0 = __metal_mcycle_read();
+
+    while ((t1 = metal_mtime_read()) < t0 + METAL_CYCLECLOCK_CALIBRATION_TICKS) ;
+    c1 = __metal_mcycle_read();
+
+    _metal_cycleclock_set_rate(cc, c1 - c0, t1 - t0);
+    if (cc->rate_hz == 0) {
+        return -1;
+    }
+    _metal_cycleclock_anchor(cc, c1, t1);
+    cc->valid = 1;
+
+    return 0;
+}
+
+int metal_cycleclock_calibrate(void)
+{
+    int hartid = __metal_current_hartid();
+    struct _metal_cycleclock *cc;
+
+    if (hartid >= __METAL_DT_MAX_HARTS) {
+        return -1;
+    }
+    cc = &_metal_cycleclocks[hartid];
+
+    cc->generation = __METAL_ACCESS_ONCE(&_metal_cycleclock_generation);
+    return _metal_cycleclock_measure(cc);
+}
+
+/* Calibrate the boot hart before main() runs */
+static void _metal_cycleclock_init(void) __attribute__((constructor));
+static void _metal_cycleclock_init(void)
+{
+    metal_cycleclock_calibrate();
+}
+
+/* Called by crt0.S on every hart before main(), to calibrate the harts which
+ * don't run constructors */
+void __metal_cycleclock_hart_init(void)
+{
+    int hartid = __metal_current_hartid();
+
+    if (hartid < __METAL_DT_MAX_HARTS && !_metal_cycleclocks[hartid].valid) {
+        metal_cycleclock_calibrate();
+    }
+}
+
+/* The cores are driven by the clock which changed, so they all run at the
+ * rate this hart measures */
+static void _metal_cycleclock_rate_changed(void *priv)
+{
+    int hartid = __metal_current_hartid();
+    struct _metal_cycleclock *cc;
+    unsigned int generation;
+
+    if (hartid >= __METAL_DT_MAX_HARTS) {
+        return;
+    }
+    cc = &_metal_cycleclocks[hartid];
+
+    if (_metal_cycleclock_measure(cc)) {
+        cc->rate_hz = 0;
+        cc->valid = 0;
+    }
+    _metal_cycleclock_rate.to_ns = cc->to_ns;
+    _metal_cycleclock_rate.resync_cycles = cc->resync_cycles;
+    _metal_cycleclock_rate.rate_hz = cc->rate_hz;
+
+    /* Publish the rate before the generation which tells harts to adopt it */
+    __asm__ volatile("fence w,w" ::: "memory");
+#ifdef __riscv_atomic
+    __asm__ volatile("amoadd.w %[old], %[one], (%[gen])"
+                     : [old] "=r" (generation)
+                     : [one] "r" (1), [gen] "r" (&_metal_cycleclock_generation)
+                     : "memory");
+#else
+    generation = _metal_cycleclock_generation++;
+#endif
+    cc->generation = generation + 1;
+}
+
+/* Take the rate published after a rate change, and anchor to mtime now,
+ * which costs a few reads rather than a calibration */
+static void _metal_cycleclock_adopt(struct _metal_cycleclock *cc,
+                                    unsigned int generation)
+{
+    __asm__ volatile("fence r,r" ::: "memory");
+    cc->to_ns = _metal_cycleclock_rate.to_ns;
+    cc->resync_cycles = _metal_cycleclock_rate.resync_cycles;
+    cc->rate_hz = _metal_cycleclock_rate.rate_hz;
+    cc->generation = generation;
+    cc->valid = cc->rate_hz != 0;
+    _metal_cycleclock_anchor(cc, __metal_mcycle_read(), metal_mtime_read());
+}
+
+int metal_cycleclock_track(struct metal_clock *clk)
+{
+    metal_clock_callback *cb;
+
+    if (_metal_cycleclock_num_clocks >= METAL_CYCLECLOCK_MAX_CLOCKS) {
+        return -1;
+    }
+    cb = &_metal_cycleclock_callbacks[_metal_cycleclock_num_clocks++];
+
+    cb->callback = _metal_cycleclock_rate_changed;
+    cb->priv = NULL;
+    metal_clock_register_post_rate_change_callback(clk, cb);
+
+    return 0;
+}
+
+unsigned long long metal_cycleclock_ns(void)
+{
+    int hartid = __metal_current_hartid();
+    struct _metal_cycleclock *cc;
+    unsigned long long cycles, ns;
+    unsigned long mstatus;
+    unsigned int generation;
+
+    if (hartid >= __METAL_DT_MAX_HARTS) {
+        return metal_timer_ticks_to_ns(metal_mtime_read());
+    }
+    cc = &_metal_cycleclocks[hartid];
+
+    /* An interrupt handler on this hart may read the clock too */
+    mstatus = __metal_irq_save();
+
+    generation = __METAL_ACCESS_ONCE(&_metal_cycleclock_generation);
+    if (cc->valid && cc->generation != generation) {
+        _metal_cycleclock_adopt(cc, generation);
+    }
+    if (!cc->valid) {
+        /* Not calibrated, so fall back to mtime rather than busy-wait */
+        __metal_irq_restore(mstatus);
+        return metal_timer_ticks_to_ns(metal_mtime_read());
+    }
+
+    cycles = __metal_mcycle_read() - cc->cycle0;
+    if (cycles >= cc->resync_cycles) {
+        /* Snap back to mtime. Only refine the rate over a period close to
+         * the resync interval, since a long one may include time spent in
+         * wfi with mcycle stopped. */
+        unsigned long long tick = metal_mtime_read();
+
+        if (cycles <= 2 * cc->resync_cycles) {
+            _metal_cycleclock_set_rate(cc, cycles, tick - cc->tick0);
+        }
+        _metal_cycleclock_anchor(cc, cc->cycle0 + cycles, tick);
+        ns = cc->ns0;
+    } else {
+        ns = cc->ns0 + __metal_timer_mul_shr(cycles, cc->to_ns.mult, cc->to_ns.shift);
+    }
+
+    if (ns < cc->last_ns) {
+        ns = cc->last_ns;
+    }
+    cc->last_ns = ns;
+
+    __metal_irq_restore(mstatus);
+
+    return ns;
+}
+
+unsigned long long metal_cycleclock_get_rate_hz(void)
+{
+    int hartid = __metal_current_hartid();
+    struct _metal_cycleclock *cc;
+    unsigned int generation;
+
+    if (hartid >= __METAL_DT_MAX_HARTS) {
+        return 0;
+    }
+    cc = &_metal_cycleclocks[hartid];
+
+    generation = __METAL_ACCESS_ONCE(&_metal_cycleclock_generation);
+    if (cc->valid && cc->generation != generation) {
+        _metal_cycleclock_adopt(cc, generation);
+    }
+    return cc->valid ? cc->rate_hz : 0;
+}
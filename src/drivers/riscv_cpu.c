@@ -7,7 +7,19 @@
 #include <metal/machine.h>
 
 
+extern __inline__ int __metal_current_hartid(void);
+extern __inline__ unsigned long __metal_irq_save(void);
+extern __inline__ void __metal_irq_restore(unsigned long mstatus);
+extern __inline__ unsigned long long __metal_mcycle_read(void);
+
 extern void __metal_vector_table();
+/* Defined when mailbox.c is linked in, see metal/mailbox.h */
+#ifndef __ICCRISCV__
+int __metal_mailbox_interrupt(int clear) __attribute__((weak));
+#else
+__weak int __metal_mailbox_interrupt(int clear);
+#endif
+void __metal_default_sw_handler (int id, void *priv);
 unsigned long long __metal_driver_cpu_mtime_get(struct metal_cpu *cpu);
 int __metal_driver_cpu_mtimecmp_set(struct metal_cpu *cpu, unsigned long long time);
 
@@ -26,11 +38,53 @@ uintptr_t __metal_myhart_id (void)
     return myhart;
 }
 
+/* Let the mailbox share a software interrupt with its registered handler.
+ * A handler registered by the program always runs, first, and clears the
+ * interrupt itself, so a call posted while it runs raises the interrupt
+ * again. Returns nonzero if there is nothing more to do. */
+static __inline__ int __metal_mailbox_sw_interrupt (struct __metal_driver_riscv_cpu_intc *intc)
+{
+    metal_interrupt_handler_t handler = intc->metal_int_table[METAL_INTERRUPT_ID_SW].handler;
+
+    if (!__metal_mailbox_interrupt) {
+        return 0;
+    }
+    if (handler && handler != __metal_default_sw_handler) {
+        handler(METAL_INTERRUPT_ID_SW, intc->metal_int_table[METAL_INTERRUPT_ID_SW].exint_data);
+        __metal_mailbox_interrupt(0);
+        return 1;
+    }
+    return __metal_mailbox_interrupt(1) || !handler;
+}
+
 void __metal_zero_memory (unsigned char *base, unsigned int size)
 {
-    volatile unsigned char *ptr;
-    for (ptr = base; ptr < (base + size); ptr++){
-        *ptr = 0;
+    unsigned char *end = base + size;
+    uintptr_t *word, *word_end;
+
+    /* Bytes up to the first word boundary */
+    while (base < end && ((uintptr_t)base & (sizeof(uintptr_t) - 1))) {
+        *base++ = 0;
+    }
+
+    /* Whole words, four at a time */
+    word = (uintptr_t *)base;
+    word_end = (uintptr_t *)((uintptr_t)end & ~(sizeof(uintptr_t) - 1));
+    while (word_end - word >= 4) {
+        word[0] = 0;
+        word[1] = 0;
+        word[2] = 0;
+        word[3] = 0;
+        word += 4;
+    }
+    while (word < word_end) {
+        *word++ = 0;
+    }
+
+    /* The bytes left over */
+    base = (unsigned char *)word;
+    while (base < end) {
+        *base++ = 0;
     }
 }
 
@@ -116,6 +170,9 @@ __weak __interrupt void metal_software_interrupt_vector_handler (void) {
     if ( cpu ) {
         intc = (struct __metal_driver_riscv_cpu_intc *)
           __metal_driver_cpu_interrupt_controller((struct metal_cpu *)cpu);
+        if (__metal_mailbox_sw_interrupt(intc)) {
+            return;
+        }
         priv = intc->metal_int_table[METAL_INTERRUPT_ID_SW].exint_data;
         intc->metal_int_table[METAL_INTERRUPT_ID_SW].handler(METAL_INTERRUPT_ID_SW, priv);
     }
@@ -178,13 +235,10 @@ __weak __interrupt void metal_external_interrupt_vector_handler (void) {
     }
 }
 
-#ifndef __ICCRISCV__
-void __metal_exception_handler(void) __attribute__((interrupt, aligned(128)));
-void __metal_exception_handler (void) {
-#else
-  /* Interrupts are default aligned to 128 for ICCRISCV */
-__interrupt void __metal_exception_handler (void) {
-#endif
+/* Look up and call the handler for the current trap. Shared by the default
+ * trap entry below and by any other trap entry, such as the preemptive
+ * scheduler's, which saves the context itself. */
+static __inline__ void __metal_exception_dispatch_inline (void) {
     int id;
     void *priv;
     uintptr_t mcause, mepc, mtval, mtvec;
@@ -203,6 +257,10 @@ __interrupt void __metal_exception_handler (void) {
         if (mcause & METAL_MCAUSE_INTR) {
             if ((id < METAL_INTERRUPT_ID_CSW) ||
                ((mtvec & METAL_MTVEC_MASK) == METAL_MTVEC_DIRECT)) {
+                if ((id == METAL_INTERRUPT_ID_SW) &&
+                    __metal_mailbox_sw_interrupt(intc)) {
+                    return;
+                }
                 priv = intc->metal_int_table[id].exint_data;
                 intc->metal_int_table[id].handler(id, priv);
 		return;
@@ -223,6 +281,20 @@ __interrupt void __metal_exception_handler (void) {
     }
 }
 
+void __metal_exception_dispatch (void) {
+    __metal_exception_dispatch_inline();
+}
+
+#ifndef __ICCRISCV__
+void __metal_exception_handler(void) __attribute__((interrupt, aligned(128)));
+void __metal_exception_handler (void) {
+#else
+  /* Interrupts are default aligned to 128 for ICCRISCV */
+__interrupt void __metal_exception_handler (void) {
+#endif
+    __metal_exception_dispatch_inline();
+}
+
 /* The metal_lc0_interrupt_vector_handler() function can be redefined. */
 #ifndef __ICCRISCV__
 void __attribute__((weak, interrupt)) metal_lc0_interrupt_vector_handler (void) {
@@ -0,0 +1,7 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <metal/hart_local.h>
+
+extern __inline__ uintptr_t metal_hart_local_base(void);
+extern __inline__ int metal_hart_local_hartid(void);
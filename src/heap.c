@@ -0,0 +1,723 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <metal/machine.h>
+#include <metal/io.h>
+#include <metal/drivers/riscv_cpu.h>
+#include <metal/heap.h>
+
+#define _METAL_HEAP_ALIGN (1UL << _METAL_HEAP_ALIGN_LOG2)
+#define _METAL_HEAP_SMALL (1UL << _METAL_HEAP_FL_SHIFT)
+
+/* The largest block, which stays within the last size class */
+#define _METAL_HEAP_MAX_BLOCK (1UL << (_METAL_HEAP_FL_MAX - 1))
+
+/* The low bits of a block's size are flags */
+#define _METAL_HEAP_FREE      1UL
+#define _METAL_HEAP_PREV_FREE 2UL
+#define _METAL_HEAP_FLAGS     (_METAL_HEAP_FREE | _METAL_HEAP_PREV_FREE)
+
+/* Every block starts with a header of two pointers, which keeps the payload
+ * aligned. A free block links itself into its free list through the first
+ * two words of its payload, which is why that's the smallest block. Each
+ * region ends with a used block of size 0 so no block merges past it. */
+struct _metal_heap_block {
+    /* The block just before this one in memory, or NULL for the first */
+    struct _metal_heap_block *prev_phys;
+    /* The size of the payload and flags */
+    size_t size;
+    struct _metal_heap_block *next_free;
+    struct _metal_heap_block *prev_free;
+};
+
+#define _METAL_HEAP_HEADER (2 * sizeof(void *))
+#define _METAL_HEAP_MIN    (2 * sizeof(void *))
+
+extern char metal_segment_data_target_start;
+extern char metal_segment_data_target_end;
+extern char metal_segment_bss_target_start;
+extern char metal_segment_bss_target_end;
+extern char metal_segment_itim_target_start;
+extern char metal_segment_itim_target_end;
+extern char metal_segment_heap_target_start;
+extern char metal_segment_heap_target_end;
+/* Only present when the linker script places the DTIM sections */
+extern char metal_segment_dtim_target_start __attribute__((weak));
+extern char metal_segment_dtim_noinit_target_end __attribute__((weak));
+extern char _sp;
+extern char __stack_size;
+
+static int _metal_heap_fls(size_t size)
+{
+    return (int)(8 * sizeof(unsigned long)) - 1 - __builtin_clzl(size);
+}
+
+static size_t _metal_heap_size(const struct _metal_heap_block *block)
+{
+    return block->size & ~_METAL_HEAP_FLAGS;
+}
+
+static void *_metal_heap_payload(struct _metal_heap_block *block)
+{
+    return (char *)block + _METAL_HEAP_HEADER;
+}
+
+static struct _metal_heap_block *_metal_heap_from_payload(void *ptr)
+{
+    return (struct _metal_heap_block *)((char *)ptr - _METAL_HEAP_HEADER);
+}
+
+static struct _metal_heap_block *_metal_heap_next(struct _metal_heap_block *block)
+{
+    return (struct _metal_heap_block *)((char *)_metal_heap_payload(block) +
+                                        _metal_heap_size(block));
+}
+
+/* Round a request up to a usable block size, or 0 if it's too big */
+static size_t _metal_heap_adjust(size_t size)
+{
+    if (size > _METAL_HEAP_MAX_BLOCK) {
+        return 0;
+    }
+    size = (size + _METAL_HEAP_ALIGN - 1) & ~(_METAL_HEAP_ALIGN - 1);
+    return size < _METAL_HEAP_MIN ? _METAL_HEAP_MIN : size;
+}
+
+/* Find the free list which holds blocks of the given size */
+static void _metal_heap_mapping(size_t size, int *fl, int *sl)
+{
+    if (size < _METAL_HEAP_SMALL) {
+        *fl = 0;
+        *sl = size >> _METAL_HEAP_ALIGN_LOG2;
+    } else {
+        int f = _metal_heap_fls(size);
+
+        *sl = (size >> (f - _METAL_HEAP_SL_LOG2)) ^ _METAL_HEAP_SL_COUNT;
+        *fl = f - _METAL_HEAP_FL_SHIFT + 1;
+    }
+}
+
+static void _metal_heap_insert(struct metal_heap *heap, struct _metal_heap_block *block)
+{
+    int fl, sl;
+
+    _metal_heap_mapping(_metal_heap_size(block), &fl, &sl);
+
+    block->prev_free = NULL;
+    block->next_free = heap->_free[fl][sl];
+    if (block->next_free) {
+        block->next_free->prev_free = block;
+    }
+    heap->_free[fl][sl] = block;
+
+    heap->_fl_bitmap |= 1U << fl;
+    heap->_sl_bitmap[fl] |= 1U << sl;
+}
+
+static void _metal_heap_remove(struct metal_heap *heap, struct _metal_heap_block *block)
+{
+    int fl, sl;
+
+    _metal_heap_mapping(_metal_heap_size(block), &fl, &sl);
+
+    if (block->next_free) {
+        block->next_free->prev_free = block->prev_free;
+    }
+    if (block->prev_free) {
+        block->prev_free->next_free = block->next_free;
+    } else {
+        heap->_free[fl][sl] = block->next_free;
+        if (!heap->_free[fl][sl]) {
+            heap->_sl_bitmap[fl] &= ~(1U << sl);
+            if (!heap->_sl_bitmap[fl]) {
+                heap->_fl_bitmap &= ~(1U << fl);
+            }
+        }
+    }
+}
+
+/* Take a free block of at least size bytes out of its free list. Rounding
+ * the size up to the next list means any block in the list found is big
+ * enough, so no list is ever searched. */
+static struct _metal_heap_block *_metal_heap_take(struct metal_heap *heap, size_t size)
+{
+    struct _metal_heap_block *block;
+    unsigned int map;
+    int fl, sl;
+
+    if (size >= _METAL_HEAP_SMALL) {
+        size += (1UL << (_metal_heap_fls(size) - _METAL_HEAP_SL_LOG2)) - 1;
+    }
+    _metal_heap_mapping(size, &fl, &sl);
+    if (fl >= _METAL_HEAP_FL_COUNT) {
+        return NULL;
+    }
+
+    map = heap->_sl_bitmap[fl] & (~0U << sl);
+    if (!map) {
+        map = heap->_fl_bitmap & (~0U << (fl + 1));
+        if (!map) {
+            return NULL;
+        }
+        fl = __builtin_ctz(map);
+        map = heap->_sl_bitmap[fl];
+    }
+    sl = __builtin_ctz(map);
+
+    block = heap->_free[fl][sl];
+    _metal_heap_remove(heap, block);
+    return block;
+}
+
+/* Cut a block down to size bytes and return the rest as a new used block */
+static struct _metal_heap_block *_metal_heap_split(struct _metal_heap_block *block,
+                                                   size_t size)
+{
+    struct _metal_heap_block *rest;
+
+    rest = (struct _metal_heap_block *)((char *)_metal_heap_payload(block) + size);
+    rest->size = _metal_heap_size(block) - size - _METAL_HEAP_HEADER;
+    rest->prev_phys = block;
+    _metal_heap_next(rest)->prev_phys = rest;
+
+    block->size = size | (block->size & _METAL_HEAP_FLAGS);
+    return rest;
+}
+
+/* Make a used block free, merging it with its free neighbours */
+static void _metal_heap_release(struct metal_heap *heap, struct _metal_heap_block *block)
+{
+    struct _metal_heap_block *next;
+
+    block->size |= _METAL_HEAP_FREE;
+
+    if (block->size & _METAL_HEAP_PREV_FREE) {
+        struct _metal_heap_block *prev = block->prev_phys;
+
+        _metal_heap_remove(heap, prev);
+        prev->size += _METAL_HEAP_HEADER + _metal_heap_size(block);
+        block = prev;
+        _metal_heap_next(block)->prev_phys = block;
+    }
+
+    next = _metal_heap_next(block);
+    if (next->size & _METAL_HEAP_FREE) {
+        _metal_heap_remove(heap, next);
+        block->size += _METAL_HEAP_HEADER + _metal_heap_size(next);
+        next = _metal_heap_next(block);
+        next->prev_phys = block;
+    }
+
+    next->size |= _METAL_HEAP_PREV_FREE;
+    _metal_heap_insert(heap, block);
+}
+
+/* Allocate a block taken from the free lists, giving back what isn't needed */
+static void *_metal_heap_use(struct metal_heap *heap, struct _metal_heap_block *block,
+                             size_t size)
+{
+    if (_metal_heap_size(block) >= size + _METAL_HEAP_HEADER + _METAL_HEAP_MIN) {
+        struct _metal_heap_block *rest = _metal_heap_split(block, size);
+
+        block->size &= ~_METAL_HEAP_FREE;
+        _metal_heap_release(heap, rest);
+    } else {
+        block->size &= ~_METAL_HEAP_FREE;
+        _metal_heap_next(block)->size &= ~_METAL_HEAP_PREV_FREE;
+    }
+
+    heap->_used += _METAL_HEAP_HEADER + _metal_heap_size(block);
+    if (heap->_used > heap->_peak_used) {
+        heap->_peak_used = heap->_used;
+    }
+    heap->_allocs++;
+
+    return _metal_heap_payload(block);
+}
+
+/* Interrupts are disabled while the heap is locked, so handlers can use it
+ * without deadlocking against the code they interrupted */
+static unsigned long _metal_heap_lock(struct metal_heap *heap)
+{
+    unsigned long mstatus;
+
+    mstatus = __metal_irq_save();
+    if (heap->_flags & METAL_HEAP_SHARED) {
+        metal_lock_take(&heap->_lock);
+    }
+    return mstatus;
+}
+
+static void _metal_heap_unlock(struct metal_heap *heap, unsigned long mstatus)
+{
+    if (heap->_flags & METAL_HEAP_SHARED) {
+        metal_lock_give(&heap->_lock);
+    }
+    __metal_irq_restore(mstatus);
+}
+
+int metal_heap_init(struct metal_heap *heap, int flags)
+{
+    memset(heap, 0, sizeof(*heap));
+    heap->_flags = flags;
+
+    if (flags & METAL_HEAP_SHARED) {
+        if (metal_lock_init(&heap->_lock)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int metal_heap_add_region(struct metal_heap *heap, void *base, size_t size)
+{
+    uintptr_t start = ((uintptr_t)base + _METAL_HEAP_ALIGN - 1) & ~(_METAL_HEAP_ALIGN - 1);
+    uintptr_t end = ((uintptr_t)base + size) & ~(_METAL_HEAP_ALIGN - 1);
+    const size_t overhead = 2 * _METAL_HEAP_HEADER;
+    unsigned long mstatus;
+
+    if (end <= start || end - start < overhead + _METAL_HEAP_MIN) {
+        return -1;
+    }
+
+    mstatus = _metal_heap_lock(heap);
+
+    /* A region too big for one block becomes several */
+    while (end - start >= overhead + _METAL_HEAP_MIN) {
+        struct _metal_heap_block *block = (struct _metal_heap_block *)start;
+        struct _metal_heap_block *sentinel;
+        size_t chunk = end - start;
+
+        if (chunk > _METAL_HEAP_MAX_BLOCK + overhead) {
+            chunk = _METAL_HEAP_MAX_BLOCK + overhead;
+        }
+
+        block->prev_phys = NULL;
+        block->size = (chunk - overhead) | _METAL_HEAP_FREE;
+
+        sentinel = _metal_heap_next(block);
+        sentinel->prev_phys = block;
+        sentinel->size = _METAL_HEAP_PREV_FREE;
+
+        _metal_heap_insert(heap, block);
+
+        heap->_total += chunk;
+        heap->_used += _METAL_HEAP_HEADER;
+        start += chunk;
+    }
+
+    _metal_heap_unlock(heap, mstatus);
+    return 0;
+}
+
+static int _metal_heap_overlaps(uintptr_t start, uintptr_t end,
+                                uintptr_t seg_start, uintptr_t seg_end)
+{
+    return start < seg_end && seg_start < end;
+}
+
+int metal_heap_add_memory(struct metal_heap *heap, struct metal_memory *memory,
+                          size_t offset, size_t size)
+{
+    uintptr_t base = metal_memory_get_base_address(memory);
+    size_t mem_size = metal_memory_get_size(memory);
+    uintptr_t start, end;
+    uintptr_t stack_size = (uintptr_t)&__stack_size;
+    /* Each hart's stack sits __stack_size above the last, see crt0.S */
+    uintptr_t stacks_start = (uintptr_t)&_sp - stack_size;
+    uintptr_t stacks_end = (uintptr_t)&_sp + (__METAL_DT_MAX_HARTS - 1) * stack_size;
+
+    if (offset >= mem_size) {
+        return -1;
+    }
+    if (size == 0) {
+        size = mem_size - offset;
+    }
+    if (size > mem_size - offset) {
+        return -1;
+    }
+    start = base + offset;
+    end = start + size;
+
+    if (_metal_heap_overlaps(start, end,
+                             (uintptr_t)&metal_segment_data_target_start,
+                             (uintptr_t)&metal_segment_data_target_end) ||
+        _metal_heap_overlaps(start, end,
+                             (uintptr_t)&metal_segment_bss_target_start,
+                             (uintptr_t)&metal_segment_bss_target_end) ||
+        _metal_heap_overlaps(start, end,
+                             (uintptr_t)&metal_segment_itim_target_start,
+                             (uintptr_t)&metal_segment_itim_target_end) ||
+        _metal_heap_overlaps(start, end,
+                             (uintptr_t)&metal_segment_heap_target_start,
+                             (uintptr_t)&metal_segment_heap_target_end) ||
+        _metal_heap_overlaps(start, end,
+                             (uintptr_t)&metal_segment_dtim_target_start,
+                             (uintptr_t)&metal_segment_dtim_noinit_target_end) ||
+        _metal_heap_overlaps(start, end, stacks_start, stacks_end)) {
+        return -1;
+    }
+
+    return metal_heap_add_region(heap, (void *)start, size);
+}
+
+#ifdef __riscv_atomic
+#define _METAL_HEAP_DEFAULT_FLAGS METAL_HEAP_SHARED
+#else
+#define _METAL_HEAP_DEFAULT_FLAGS 0
+#endif
+
+static struct metal_heap _metal_heap_default;
+
+/* 0 until the default heap is set up, then 1, or -1 if that failed */
+static int _metal_heap_default_state = 0;
+
+#ifdef __riscv_atomic
+METAL_LOCK_DECLARE(_metal_heap_default_lock);
+
+static void _metal_heap_default_lock_init(void) __attribute__((constructor));
+static void _metal_heap_default_lock_init(void)
+{
+    metal_lock_init(&_metal_heap_default_lock);
+}
+#endif
+
+static int _metal_heap_default_init(void)
+{
+    char *start = sbrk(0);
+    ptrdiff_t size;
+
+    if (metal_heap_init(&_metal_heap_default, _METAL_HEAP_DEFAULT_FLAGS)) {
+        return -1;
+    }
+    if (start == (char *)-1) {
+        return -1;
+    }
+
+    /* Claim the rest of the heap segment from the C library */
+    size = &metal_segment_heap_target_end - start;
+    if (size <= 0 || sbrk(size) != start) {
+        return -1;
+    }
+    return metal_heap_add_region(&_metal_heap_default, start, size);
+}
+
+struct metal_heap *metal_heap_default(void)
+{
+    if (!__METAL_ACCESS_ONCE(&_metal_heap_default_state)) {
+#ifdef __riscv_atomic
+        metal_lock_take(&_metal_heap_default_lock);
+#endif
+        if (!_metal_heap_default_state) {
+            int state = _metal_heap_default_init() ? -1 : 1;
+
+            __METAL_IO_FENCE(rw, w)
+            __METAL_ACCESS_ONCE(&_metal_heap_default_state) = state;
+        }
+#ifdef __riscv_atomic
+        metal_lock_give(&_metal_heap_default_lock);
+#endif
+    }
+    __METAL_IO_FENCE(r, rw)
+
+    return _metal_heap_default_state > 0 ? &_metal_heap_default : NULL;
+}
+
+static void _metal_heap_alloc_done(struct metal_heap *heap, void *ptr,
+                                   unsigned long start)
+{
+    unsigned long cycles = __metal_mcycle_read() - start;
+
+    if (!ptr) {
+        heap->_failures++;
+    }
+    if (cycles > heap->_max_alloc_cycles) {
+        heap->_max_alloc_cycles = cycles;
+    }
+}
+
+void *metal_heap_alloc(struct metal_heap *heap, size_t size)
+{
+    unsigned long start = __metal_mcycle_read();
+    size_t adjust = _metal_heap_adjust(size);
+    struct _metal_heap_block *block = NULL;
+    unsigned long mstatus;
+    void *ptr = NULL;
+
+    mstatus = _metal_heap_lock(heap);
+    if (adjust) {
+        block = _metal_heap_take(heap, adjust);
+    }
+    if (block) {
+        ptr = _metal_heap_use(heap, block, adjust);
+    }
+    _metal_heap_alloc_done(heap, ptr, start);
+    _metal_heap_unlock(heap, mstatus);
+
+    return ptr;
+}
+
+void *metal_heap_aligned_alloc(struct metal_heap *heap, size_t align, size_t size)
+{
+    unsigned long start;
+    size_t adjust, gap_min = _METAL_HEAP_HEADER + _METAL_HEAP_MIN;
+    struct _metal_heap_block *block = NULL;
+    unsigned long mstatus;
+    void *ptr = NULL;
+
+    if (align <= _METAL_HEAP_ALIGN) {
+        return metal_heap_alloc(heap, size);
+    }
+    if (align & (align - 1)) {
+        return NULL;
+    }
+
+    start = __metal_mcycle_read();
+    adjust = _metal_heap_adjust(size);
+
+    mstatus = _metal_heap_lock(heap);
+    /* Ask for enough to find an aligned address with room for a free block
+     * before it */
+    if (adjust && adjust + align + gap_min <= _METAL_HEAP_MAX_BLOCK) {
+        block = _metal_heap_take(heap, adjust + align + gap_min);
+    }
+    if (block) {
+        uintptr_t payload = (uintptr_t)_metal_heap_payload(block);
+        uintptr_t aligned = (payload + align - 1) & ~(align - 1);
+
+        if (aligned != payload && aligned - payload < gap_min) {
+            aligned = (payload + gap_min + align - 1) & ~(align - 1);
+        }
+        if (aligned != payload) {
+            /* Give back the space before the aligned block */
+            struct _metal_heap_block *rest;
+
+            rest = _metal_heap_split(block, aligned - payload - _METAL_HEAP_HEADER);
+            rest->size |= _METAL_HEAP_PREV_FREE;
+            _metal_heap_insert(heap, block);
+            block = rest;
+        }
+        ptr = _metal_heap_use(heap, block, adjust);
+    }
+    _metal_heap_alloc_done(heap, ptr, start);
+    _metal_heap_unlock(heap, mstatus);
+
+    return ptr;
+}
+
+void metal_heap_free(struct metal_heap *heap, void *ptr)
+{
+    unsigned long start, cycles;
+    struct _metal_heap_block *block;
+    unsigned long mstatus;
+
+    if (!ptr) {
+        return;
+    }
+
+    start = __metal_mcycle_read();
+    block = _metal_heap_from_payload(ptr);
+
+    mstatus = _metal_heap_lock(heap);
+    heap->_used -= _METAL_HEAP_HEADER + _metal_heap_size(block);
+    heap->_frees++;
+    _metal_heap_release(heap, block);
+
+    cycles = __metal_mcycle_read() - start;
+    if (cycles > heap->_max_free_cycles) {
+        heap->_max_free_cycles = cycles;
+    }
+    _metal_heap_unlock(heap, mstatus);
+}
+
+void *metal_heap_realloc(struct metal_heap *heap, void *ptr, size_t size)
+{
+    struct _metal_heap_block *block, *next;
+    size_t adjust, cur;
+    unsigned long mstatus;
+    void *moved;
+
+    if (!ptr) {
+        return metal_heap_alloc(heap, size);
+    }
+    if (!size) {
+        metal_heap_free(heap, ptr);
+        return NULL;
+    }
+
+    adjust = _metal_heap_adjust(size);
+    if (!adjust) {
+        return NULL;
+    }
+
+    block = _metal_heap_from_payload(ptr);
+
+    mstatus = _metal_heap_lock(heap);
+    cur = _metal_heap_size(block);
+    next = _metal_heap_next(block);
+
+    if (adjust > cur && (next->size & _METAL_HEAP_FREE) &&
+        cur + _METAL_HEAP_HEADER + _metal_heap_size(next) >= adjust) {
+        /* Grow into the next block */
+        _metal_heap_remove(heap, next);
+        block->size += _METAL_HEAP_HEADER + _metal_heap_size(next);
+        next = _metal_heap_next(block);
+        next->prev_phys = block;
+        next->size &= ~_METAL_HEAP_PREV_FREE;
+    }
+
+    if (adjust <= _metal_heap_size(block)) {
+        heap->_used -= _METAL_HEAP_HEADER + cur;
+        if (_metal_heap_size(block) >= adjust + _METAL_HEAP_HEADER + _METAL_HEAP_MIN) {
+            _metal_heap_release(heap, _metal_heap_split(block, adjust));
+        }
+        heap->_used += _METAL_HEAP_HEADER + _metal_heap_size(block);
+        if (heap->_used > heap->_peak_used) {
+            heap->_peak_used = heap->_used;
+        }
+        _metal_heap_unlock(heap, mstatus);
+        return ptr;
+    }
+    _metal_heap_unlock(heap, mstatus);
+
+    moved = metal_heap_alloc(heap, size);
+    if (moved) {
+        memcpy(moved, ptr, cur);
+        metal_heap_free(heap, ptr);
+    }
+    return moved;
+}
+
+void metal_heap_get_stats(struct metal_heap *heap, struct metal_heap_stats *stats)
+{
+    unsigned long mstatus;
+    size_t largest = 0;
+
+    mstatus = _metal_heap_lock(heap);
+
+    /* The largest block is in the highest non-empty list */
+    if (heap->_fl_bitmap) {
+        int fl = _metal_heap_fls(heap->_fl_bitmap);
+        int sl = _metal_heap_fls(heap->_sl_bitmap[fl]);
+
+        for (struct _metal_heap_block *block = heap->_free[fl][sl]; block;
+             block = block->next_free) {
+            if (_metal_heap_size(block) > largest) {
+                largest = _metal_heap_size(block);
+            }
+        }
+    }
+
+    stats->total = heap->_total;
+    stats->used = heap->_used;
+    stats->peak_used = heap->_peak_used;
+    stats->free = heap->_total - heap->_used;
+    stats->largest_free = largest;
+    stats->fragmentation = stats->free ?
+        1000 - (unsigned int)((unsigned long long)largest * 1000 / stats->free) : 0;
+    stats->allocs = heap->_allocs;
+    stats->frees = heap->_frees;
+    stats->failures = heap->_failures;
+    stats->max_alloc_cycles = heap->_max_alloc_cycles;
+    stats->max_free_cycles = heap->_max_free_cycles;
+
+    _metal_heap_unlock(heap, mstatus);
+}
+
+#ifdef METAL_HEAP_MALLOC
+
+#include <errno.h>
+#include <stdlib.h>
+
+struct _reent;
+
+void *malloc(size_t size)
+{
+    struct metal_heap *heap = metal_heap_default();
+    void *ptr = heap ? metal_heap_alloc(heap, size) : NULL;
+
+    if (!ptr) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+void free(void *ptr)
+{
+    if (ptr) {
+        metal_heap_free(&_metal_heap_default, ptr);
+    }
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    struct metal_heap *heap = metal_heap_default();
+    void *moved = heap ? metal_heap_realloc(heap, ptr, size) : NULL;
+
+    if (!moved && size) {
+        errno = ENOMEM;
+    }
+    return moved;
+}
+
+void *calloc(size_t count, size_t size)
+{
+    void *ptr;
+
+    if (size && count > (size_t)-1 / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    ptr = malloc(count * size);
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void *memalign(size_t align, size_t size)
+{
+    struct metal_heap *heap = metal_heap_default();
+    void *ptr = heap ? metal_heap_aligned_alloc(heap, align, size) : NULL;
+
+    if (!ptr) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+/* The C library calls the reentrant versions internally */
+void *_malloc_r(struct _reent *r, size_t size)
+{
+    return malloc(size);
+}
+
+void _free_r(struct _reent *r, void *ptr)
+{
+    free(ptr);
+}
+
+void *_realloc_r(struct _reent *r, void *ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+void *_calloc_r(struct _reent *r, size_t count, size_t size)
+{
+    return calloc(count, size);
+}
+
+void *_memalign_r(struct _reent *r, size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+#endif /* METAL_HEAP_MALLOC */
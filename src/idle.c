@@ -0,0 +1,138 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <limits.h>
+#include <stddef.h>
+#include <metal/machine.h>
+#include <metal/cpu.h>
+#include <metal/drivers/riscv_cpu.h>
+#include <metal/timer.h>
+#include <metal/swtimer.h>
+#include <metal/idle.h>
+
+static struct metal_idle_stats _metal_idle_stats[__METAL_DT_MAX_HARTS];
+
+static struct {
+    metal_idle_veto veto;
+    void *arg;
+} _metal_idle_vetoes[METAL_IDLE_MAX_VETOES];
+static int _metal_idle_num_vetoes = 0;
+
+void __attribute__((weak)) metal_idle_deep_enter(unsigned long long deadline)
+{
+    __asm__ volatile("wfi");
+}
+
+static int _metal_idle_vetoed(unsigned long long ticks)
+{
+    for (int i = 0; i < _metal_idle_num_vetoes; i++) {
+        if (_metal_idle_vetoes[i].veto(_metal_idle_vetoes[i].arg, ticks)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void metal_idle(void)
+{
+    int hartid = __metal_current_hartid();
+    struct metal_cpu *cpu = metal_cpu_get(hartid);
+    struct metal_idle_stats *stats;
+    unsigned long long deadline, start, ticks;
+    unsigned long mstatus;
+    int deep = 0;
+
+    if (!cpu || hartid >= __METAL_DT_MAX_HARTS) {
+        __asm__ volatile("wfi");
+        return;
+    }
+    stats = &_metal_idle_stats[hartid];
+
+    /* With interrupts disabled, nothing can change the next deadline between
+     * reading it and going to sleep. A pending interrupt still ends the wfi,
+     * and is taken once they are enabled again. */
+    mstatus = __metal_irq_save();
+
+    start = metal_mtime_read();
+    deadline = metal_swtimer_next_event();
+
+    if (deadline > start) {
+        ticks = (deadline == ULLONG_MAX) ? ULLONG_MAX : deadline - start;
+
+        if (ticks >= METAL_IDLE_DEEP_MIN_TICKS) {
+            if (_metal_idle_vetoed(ticks)) {
+                stats->vetoed++;
+            } else {
+                deep = 1;
+            }
+        }
+
+        if (deep) {
+            metal_idle_deep_enter(deadline);
+        } else {
+            __asm__ volatile("wfi");
+        }
+
+        ticks = metal_mtime_read() - start;
+
+        stats->entries++;
+        stats->deep_entries += deep;
+        stats->idle_ticks += ticks;
+        if (ticks > stats->max_ticks) {
+            stats->max_ticks = ticks;
+        }
+    }
+
+    __metal_irq_restore(mstatus);
+}
+
+static void _metal_idle_wakeup(struct metal_swtimer *timer, void *arg) { }
+
+int metal_idle_until(unsigned long long deadline)
+{
+    struct metal_swtimer wakeup;
+
+    metal_swtimer_init(&wakeup, _metal_idle_wakeup, NULL);
+    if (metal_swtimer_start(&wakeup, deadline)) {
+        return -1;
+    }
+
+    metal_idle();
+
+    metal_swtimer_cancel(&wakeup);
+    return 0;
+}
+
+int metal_idle_veto_register(metal_idle_veto veto, void *arg)
+{
+    if (_metal_idle_num_vetoes >= METAL_IDLE_MAX_VETOES) {
+        return -1;
+    }
+
+    _metal_idle_vetoes[_metal_idle_num_vetoes].veto = veto;
+    _metal_idle_vetoes[_metal_idle_num_vetoes].arg = arg;
+    _metal_idle_num_vetoes++;
+
+    return 0;
+}
+
+int metal_idle_get_stats(int hartid, struct metal_idle_stats *stats)
+{
+    if (hartid < 0 || hartid >= __METAL_DT_MAX_HARTS) {
+        return -1;
+    }
+
+    *stats = _metal_idle_stats[hartid];
+    return 0;
+}
+
+void metal_idle_reset_stats(void)
+{
+    for (int i = 0; i < __METAL_DT_MAX_HARTS; i++) {
+        _metal_idle_stats[i].entries = 0;
+        _metal_idle_stats[i].deep_entries = 0;
+        _metal_idle_stats[i].vetoed = 0;
+        _metal_idle_stats[i].idle_ticks = 0;
+        _metal_idle_stats[i].max_ticks = 0;
+    }
+}
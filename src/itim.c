@@ -0,0 +1,58 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <stddef.h>
+#include <string.h>
+#include <metal/cache.h>
+#include <metal/drivers/riscv_cpu.h>
+#include <metal/io.h>
+#include <metal/itim.h>
+#include <metal/shutdown.h>
+
+/* Provided by the linker script when it has an overlay region */
+extern char metal_segment_itim_overlay_target_start[] __attribute__((weak));
+extern char metal_segment_itim_overlay_target_end[] __attribute__((weak));
+
+/* Read by _metal_itim_overlay_enter */
+const struct metal_itim_overlay *__metal_itim_overlay_current = NULL;
+
+int metal_itim_load(const struct metal_itim_overlay *overlay)
+{
+    size_t size = overlay->_load_end - overlay->_load_start;
+    size_t room = metal_segment_itim_overlay_target_end -
+                  metal_segment_itim_overlay_target_start;
+
+    if (overlay == __metal_itim_overlay_current) {
+        return 0;
+    }
+    if (size > room) {
+        return -1;
+    }
+
+    /* Nothing is loaded while the region is being overwritten */
+    __METAL_ACCESS_ONCE(&__metal_itim_overlay_current) = NULL;
+
+    memcpy(metal_segment_itim_overlay_target_start, overlay->_load_start, size);
+
+    /* Drop any stale copy of the old overlay from the instruction cache, and
+     * make sure the new code is visible to instruction fetch */
+    metal_icache_l1_flush(__metal_current_hartid());
+    __asm__ volatile("fence.i" ::: "memory");
+
+    __METAL_ACCESS_ONCE(&__metal_itim_overlay_current) = overlay;
+    return 0;
+}
+
+const struct metal_itim_overlay *metal_itim_loaded(void)
+{
+    return __METAL_ACCESS_ONCE(&__metal_itim_overlay_current);
+}
+
+/* Called by _metal_itim_overlay_enter when a stub finds its overlay isn't
+ * loaded. The stub has nowhere to return an error to. */
+void _metal_itim_overlay_switch(const struct metal_itim_overlay *overlay)
+{
+    if (metal_itim_load(overlay) != 0) {
+        metal_shutdown(500);
+    }
+}
@@ -1,8 +1,188 @@
 /* Copyright 2019 SiFive, Inc */
 /* SPDX-License-Identifier: Apache-2.0 */
 
+#include <metal/io.h>
+#include <metal/drivers/riscv_cpu.h>
 #include <metal/lock.h>
+#include <metal/tty.h>
 
 extern __inline__ int metal_lock_init(struct metal_lock *lock);
 extern __inline__ int metal_lock_take(struct metal_lock *lock);
 extern __inline__ int metal_lock_give(struct metal_lock *lock);
+
+#ifdef METAL_LOCK_PROFILE
+
+/* The table of profiled locks. The count is updated with an AMO, so it lives
+ * in the same section as the locks themselves. */
+static struct metal_lock *_metal_lock_profile_table[METAL_LOCK_PROFILE_MAX_LOCKS];
+__attribute__((section(".data.locks")))
+static int _metal_lock_profile_count = 0;
+
+unsigned long long _metal_lock_profile_cycles(void)
+{
+    return __metal_mcycle_read();
+}
+
+void _metal_lock_profile_register(struct metal_lock *lock)
+{
+    int count = __METAL_ACCESS_ONCE(&_metal_lock_profile_count);
+    int slot;
+
+    if (count > METAL_LOCK_PROFILE_MAX_LOCKS) {
+        count = METAL_LOCK_PROFILE_MAX_LOCKS;
+    }
+
+    /* Re-initializing a lock must not add it twice */
+    for (int i = 0; i < count; i++) {
+        if (_metal_lock_profile_table[i] == lock) {
+            return;
+        }
+    }
+
+    lock->_stats._acquisitions = 0;
+    lock->_stats._contended = 0;
+    lock->_stats._spin_cycles = 0;
+    lock->_stats._max_hold_cycles = 0;
+    lock->_stats._owner = -1;
+
+    __asm__ volatile("amoadd.w %[slot], %[one], (%[count])"
+                     : [slot] "=r" (slot)
+                     : [one] "r" (1), [count] "r" (&_metal_lock_profile_count)
+                     : "memory");
+
+    if (slot < METAL_LOCK_PROFILE_MAX_LOCKS) {
+        _metal_lock_profile_table[slot] = lock;
+    }
+}
+
+void _metal_lock_profile_taken(struct metal_lock *lock, unsigned long long start, int contended)
+{
+    unsigned long long now = _metal_lock_profile_cycles();
+    int hartid = __metal_current_hartid();
+
+    lock->_stats._acquisitions++;
+    if (contended) {
+        lock->_stats._contended++;
+        lock->_stats._spin_cycles += now - start;
+    }
+    lock->_stats._taken_at = now;
+    lock->_stats._owner = hartid;
+}
+
+void _metal_lock_profile_given(struct metal_lock *lock)
+{
+    unsigned long long held = _metal_lock_profile_cycles() - lock->_stats._taken_at;
+
+    if (held > lock->_stats._max_hold_cycles) {
+        lock->_stats._max_hold_cycles = held;
+    }
+    lock->_stats._owner = -1;
+}
+
+static void _metal_lock_profile_puts(const char *s)
+{
+    while (*s) {
+        metal_tty_putc(*s++);
+    }
+}
+
+static void _metal_lock_profile_putu(unsigned long long val)
+{
+    char buf[21];
+    int i = sizeof(buf) - 1;
+
+    buf[i] = '\0';
+    do {
+        buf[--i] = '0' + (val % 10);
+        val /= 10;
+    } while (val);
+
+    _metal_lock_profile_puts(&buf[i]);
+}
+
+void metal_lock_profile_dump(unsigned int top)
+{
+    struct metal_lock *sorted[METAL_LOCK_PROFILE_MAX_LOCKS];
+    int count = __METAL_ACCESS_ONCE(&_metal_lock_profile_count);
+    int n = 0;
+
+    if (count > METAL_LOCK_PROFILE_MAX_LOCKS) {
+        count = METAL_LOCK_PROFILE_MAX_LOCKS;
+    }
+
+    /* Skip slots which another hart has claimed but not yet filled in */
+    for (int i = 0; i < count; i++) {
+        if (_metal_lock_profile_table[i]) {
+            sorted[n++] = _metal_lock_profile_table[i];
+        }
+    }
+    count = n;
+
+    if (top == 0 || top > (unsigned int)count) {
+        top = count;
+    }
+
+    /* The table is small, so a partial selection sort is plenty */
+    for (unsigned int i = 0; i < top; i++) {
+        for (int j = i + 1; j < count; j++) {
+            if (sorted[j]->_stats._spin_cycles > sorted[i]->_stats._spin_cycles) {
+                struct metal_lock *tmp = sorted[i];
+                sorted[i] = sorted[j];
+                sorted[j] = tmp;
+            }
+        }
+    }
+
+    _metal_lock_profile_puts("lock\tacquired\tcontended\tspin cycles\tmax hold cycles\towner\n");
+    for (unsigned int i = 0; i < top; i++) {
+        const struct metal_lock_stats *stats = &sorted[i]->_stats;
+
+        _metal_lock_profile_puts(stats->_name ? stats->_name : "?");
+        _metal_lock_profile_puts("\t");
+        _metal_lock_profile_putu(stats->_acquisitions);
+        _metal_lock_profile_puts("\t");
+        _metal_lock_profile_putu(stats->_contended);
+        _metal_lock_profile_puts("\t");
+        _metal_lock_profile_putu(stats->_spin_cycles);
+        _metal_lock_profile_puts("\t");
+        _metal_lock_profile_putu(stats->_max_hold_cycles);
+        _metal_lock_profile_puts("\t");
+        if (stats->_owner < 0) {
+            _metal_lock_profile_puts("-");
+        } else {
+            _metal_lock_profile_putu(stats->_owner);
+        }
+        _metal_lock_profile_puts("\n");
+    }
+}
+
+void metal_lock_profile_reset(void)
+{
+    int count = __METAL_ACCESS_ONCE(&_metal_lock_profile_count);
+
+    if (count > METAL_LOCK_PROFILE_MAX_LOCKS) {
+        count = METAL_LOCK_PROFILE_MAX_LOCKS;
+    }
+
+    for (int i = 0; i < count; i++) {
+        struct metal_lock_stats *stats;
+
+        if (!_metal_lock_profile_table[i]) {
+            continue;
+        }
+        stats = &_metal_lock_profile_table[i]->_stats;
+
+        stats->_acquisitions = 0;
+        stats->_contended = 0;
+        stats->_spin_cycles = 0;
+        stats->_max_hold_cycles = 0;
+    }
+}
+
+#else /* !METAL_LOCK_PROFILE */
+
+void metal_lock_profile_dump(unsigned int top) { }
+
+void metal_lock_profile_reset(void) { }
+
+#endif /* METAL_LOCK_PROFILE */
@@ -0,0 +1,296 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <stdint.h>
+#include <metal/machine.h>
+#include <metal/io.h>
+#include <metal/cpu.h>
+#include <metal/interrupt.h>
+#include <metal/ringbuf.h>
+#include <metal/mailbox.h>
+
+#if METAL_MAILBOX_DEPTH & (METAL_MAILBOX_DEPTH - 1)
+#error "METAL_MAILBOX_DEPTH must be a power of two"
+#endif
+
+#ifdef __riscv_atomic
+
+struct _metal_mailbox_msg {
+    metal_hart_call_fn fn;
+    void *arg;
+    /* Decremented once fn has returned, or NULL if nobody is waiting */
+    int *pending;
+};
+
+__attribute__((section(".data.locks")))
+static struct metal_mpmc_ringbuf _metal_mailbox_rings[__METAL_DT_MAX_HARTS];
+
+/* Set by the sender which finds a mailbox idle, and cleared by its hart just
+ * before draining it. Only the sender which sets it raises the software
+ * interrupt, so a burst of calls costs the target one interrupt. */
+__attribute__((section(".data.locks")))
+static int _metal_mailbox_kicked[__METAL_DT_MAX_HARTS];
+
+static struct _metal_mailbox_msg _metal_mailbox_msgs[__METAL_DT_MAX_HARTS][METAL_MAILBOX_DEPTH];
+static unsigned int _metal_mailbox_seq[__METAL_DT_MAX_HARTS][METAL_MAILBOX_DEPTH];
+static int _metal_mailbox_ready = 0;
+
+static void _metal_mailbox_init(void) __attribute__((constructor));
+static void _metal_mailbox_init(void)
+{
+    for (int i = 0; i < __METAL_DT_MAX_HARTS; i++) {
+        if (metal_mpmc_ringbuf_init(&_metal_mailbox_rings[i], _metal_mailbox_msgs[i],
+                                    _metal_mailbox_seq[i],
+                                    sizeof(struct _metal_mailbox_msg),
+                                    METAL_MAILBOX_DEPTH)) {
+            return;
+        }
+    }
+    _metal_mailbox_ready = 1;
+}
+
+static int _metal_mailbox_swap(int *addr, int value)
+{
+    int old;
+
+    __asm__ volatile("amoswap.w.aqrl %[old], %[value], (%[addr])"
+                     : [old] "=r" (old)
+                     : [value] "r" (value), [addr] "r" (addr)
+                     : "memory");
+    return old;
+}
+
+static int _metal_mailbox_drain(int hartid)
+{
+    struct metal_mpmc_ringbuf *rb = &_metal_mailbox_rings[hartid];
+    struct _metal_mailbox_msg *slot, msg;
+    unsigned int ticket;
+    int count = 0;
+
+    while ((slot = metal_mpmc_ringbuf_peek(rb, &ticket)) != NULL) {
+        /* Free the slot before running the call, which may take a while */
+        msg = *slot;
+        metal_mpmc_ringbuf_consume(rb, ticket);
+
+        msg.fn(msg.arg);
+        if (msg.pending) {
+            /* After this, pending may go out of scope on the caller's hart */
+            __asm__ volatile("amoadd.w.aqrl zero, %[one], (%[pending])"
+                             :: [one] "r" (-1), [pending] "r" (msg.pending)
+                             : "memory");
+        }
+        count++;
+    }
+    return count;
+}
+
+/* Called by the CPU interrupt controller's software interrupt handler. When
+ * the program registered its own handler, that handler has already run and
+ * cleared the interrupt, so clear is 0. Returns nonzero if the interrupt
+ * delivered calls. */
+int __metal_mailbox_interrupt(int clear)
+{
+    int hartid = __metal_current_hartid();
+
+    if (!_metal_mailbox_ready || hartid >= __METAL_DT_MAX_HARTS) {
+        return 0;
+    }
+
+    /* Clear the interrupt before looking for calls, so a call posted from
+     * here on raises it again */
+    if (clear) {
+        metal_cpu_software_clear_ipi(metal_cpu_get(hartid), hartid);
+    }
+    if (!_metal_mailbox_swap(&_metal_mailbox_kicked[hartid], 0)) {
+        return 0;
+    }
+    _metal_mailbox_drain(hartid);
+    return 1;
+}
+
+static void _metal_mailbox_post(int hartid, metal_hart_call_fn fn, void *arg,
+                                int *pending)
+{
+    struct metal_mpmc_ringbuf *rb = &_metal_mailbox_rings[hartid];
+    struct _metal_mailbox_msg *slot;
+    unsigned int ticket;
+
+    while ((slot = metal_mpmc_ringbuf_reserve(rb, &ticket)) == NULL) {
+        /* The target may be stuck posting to us, so keep our mailbox moving */
+        metal_mailbox_poll();
+    }
+    slot->fn = fn;
+    slot->arg = arg;
+    slot->pending = pending;
+    metal_mpmc_ringbuf_commit(rb, ticket);
+
+    if (_metal_mailbox_swap(&_metal_mailbox_kicked[hartid], 1) == 0) {
+        metal_cpu_software_set_ipi(metal_cpu_get(hartid), hartid);
+    }
+}
+
+static void _metal_mailbox_wait(int *pending)
+{
+    while (__METAL_ACCESS_ONCE(pending)) {
+        metal_mailbox_poll();
+    }
+    __METAL_IO_FENCE(r, rw)
+}
+
+int metal_mailbox_enable(void)
+{
+    int hartid = __metal_current_hartid();
+    struct metal_cpu *cpu = metal_cpu_get(hartid);
+    struct metal_interrupt *cpu_intr, *sw_intr;
+
+    if (!_metal_mailbox_ready || !cpu) {
+        return -1;
+    }
+    cpu_intr = metal_cpu_interrupt_controller(cpu);
+    sw_intr = metal_cpu_software_interrupt_controller(cpu);
+    if (!cpu_intr || !sw_intr) {
+        return -1;
+    }
+    metal_interrupt_init(cpu_intr);
+    metal_interrupt_init(sw_intr);
+    if (metal_interrupt_enable(sw_intr, metal_cpu_software_get_interrupt_id(cpu))) {
+        return -1;
+    }
+
+    /* Calls posted before the interrupt was enabled */
+    metal_mailbox_poll();
+    return 0;
+}
+
+int metal_mailbox_poll(void)
+{
+    int hartid = __metal_current_hartid();
+
+    if (!_metal_mailbox_ready || hartid >= __METAL_DT_MAX_HARTS) {
+        return 0;
+    }
+    _metal_mailbox_swap(&_metal_mailbox_kicked[hartid], 0);
+    return _metal_mailbox_drain(hartid);
+}
+
+int metal_hart_call(int hartid, metal_hart_call_fn fn, void *arg, int wait)
+{
+    int pending = 1;
+
+    if (hartid == __metal_current_hartid()) {
+        fn(arg);
+        return 0;
+    }
+    if (!_metal_mailbox_ready || hartid < 0 || hartid >= __METAL_DT_MAX_HARTS) {
+        return -1;
+    }
+
+    _metal_mailbox_post(hartid, fn, arg, wait ? &pending : NULL);
+    if (wait) {
+        _metal_mailbox_wait(&pending);
+    }
+    return 0;
+}
+
+int metal_hart_call_many(unsigned long harts, metal_hart_call_fn fn, void *arg,
+                         int wait)
+{
+    int self = __metal_current_hartid();
+    int nharts = __METAL_DT_MAX_HARTS;
+    int pending = 0;
+    int rc = 0;
+
+    if (nharts > (int)(8 * sizeof(harts))) {
+        nharts = 8 * sizeof(harts);
+    }
+    if (nharts < (int)(8 * sizeof(harts)) && (harts >> nharts)) {
+        harts &= (1UL << nharts) - 1;
+        rc = -1;
+    }
+
+    /* Every target must be counted before the first one can finish */
+    for (int i = 0; i < nharts; i++) {
+        if (i != self && (harts & (1UL << i))) {
+            pending++;
+        }
+    }
+    if (pending && !_metal_mailbox_ready) {
+        harts &= self < nharts ? 1UL << self : 0;
+        pending = 0;
+        rc = -1;
+    }
+
+    for (int i = 0; i < nharts; i++) {
+        if (i != self && (harts & (1UL << i))) {
+            _metal_mailbox_post(i, fn, arg, wait ? &pending : NULL);
+        }
+    }
+
+    /* Our share runs while the other harts run theirs */
+    if (self < nharts && (harts & (1UL << self))) {
+        fn(arg);
+    }
+
+    if (wait) {
+        _metal_mailbox_wait(&pending);
+    }
+    return rc;
+}
+
+int metal_hart_call_others(metal_hart_call_fn fn, void *arg, int wait)
+{
+    int self = __metal_current_hartid();
+    int nharts = __METAL_DT_MAX_HARTS;
+    unsigned long harts = ~0UL;
+
+    if (nharts < (int)(8 * sizeof(harts))) {
+        harts = (1UL << nharts) - 1;
+    }
+    if (self < (int)(8 * sizeof(harts))) {
+        harts &= ~(1UL << self);
+    }
+
+    return metal_hart_call_many(harts, fn, arg, wait);
+}
+
+#else /* !__riscv_atomic */
+
+/* Without atomics the mailboxes can't be shared, so only the current hart can
+ * be called */
+int metal_mailbox_enable(void)
+{
+    return -1;
+}
+
+int metal_mailbox_poll(void)
+{
+    return 0;
+}
+
+int metal_hart_call(int hartid, metal_hart_call_fn fn, void *arg, int wait)
+{
+    if (hartid != __metal_current_hartid()) {
+        return -1;
+    }
+    fn(arg);
+    return 0;
+}
+
+int metal_hart_call_many(unsigned long harts, metal_hart_call_fn fn, void *arg,
+                         int wait)
+{
+    int self = __metal_current_hartid();
+
+    if (self < (int)(8 * sizeof(harts)) && (harts & (1UL << self))) {
+        harts &= ~(1UL << self);
+        fn(arg);
+    }
+    return harts ? -1 : 0;
+}
+
+int metal_hart_call_others(metal_hart_call_fn fn, void *arg, int wait)
+{
+    return __METAL_DT_MAX_HARTS > 1 ? -1 : 0;
+}
+
+#endif /* __riscv_atomic */
@@ -2,23 +2,128 @@
 /* SPDX-License-Identifier: Apache-2.0 */
 
 #include <metal/machine.h>
+#include <metal/io.h>
 #include <metal/memory.h>
 
-struct metal_memory *metal_get_memory_from_address(const uintptr_t address) {
+/* The memory table ordered by base address, built at startup. Until then
+ * lookups fall back to scanning the table. */
+static struct metal_memory *_metal_memory_sorted[__METAL_DT_MAX_MEMORIES];
+static int _metal_memory_sorted_valid = 0;
+
+/* The block found by the last lookup. It is checked before it is used, so a
+ * stale value from another hart is harmless. */
+static struct metal_memory *_metal_memory_last = NULL;
+
+static int _metal_memory_contains(const struct metal_memory *mem, uintptr_t address) {
+	return (address - metal_memory_get_base_address(mem)) < metal_memory_get_size(mem);
+}
+
+static void _metal_memory_sort(void) __attribute__((constructor));
+static void _metal_memory_sort(void) {
 	for(int i = 0; i < __METAL_DT_MAX_MEMORIES; i++) {
 		struct metal_memory *mem = __metal_memory_table[i];
+		int j = i;
+
+		while((j > 0) && (metal_memory_get_base_address(_metal_memory_sorted[j - 1]) >
+		                  metal_memory_get_base_address(mem))) {
+			_metal_memory_sorted[j] = _metal_memory_sorted[j - 1];
+			j--;
+		}
+		_metal_memory_sorted[j] = mem;
+	}
+
+	__METAL_IO_FENCE(w, w)
+	_metal_memory_sorted_valid = 1;
+}
+
+static struct metal_memory *_metal_memory_search(uintptr_t address) {
+	int lo = 0;
+	int hi = __METAL_DT_MAX_MEMORIES;
+
+	if(!__METAL_ACCESS_ONCE(&_metal_memory_sorted_valid)) {
+		for(int i = 0; i < __METAL_DT_MAX_MEMORIES; i++) {
+			if(_metal_memory_contains(__metal_memory_table[i], address)) {
+				return __metal_memory_table[i];
+			}
+		}
+		return NULL;
+	}
 
-		uintptr_t lower_bound = metal_memory_get_base_address(mem);
-		uintptr_t upper_bound  = lower_bound + metal_memory_get_size(mem);
+	/* Find the last block which starts at or below the address */
+	while(lo < hi) {
+		int mid = lo + (hi - lo) / 2;
 
-		if((address >= lower_bound) && (address < upper_bound)) {
-			return mem;
+		if(metal_memory_get_base_address(_metal_memory_sorted[mid]) <= address) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
 		}
 	}
 
+	if((lo > 0) && _metal_memory_contains(_metal_memory_sorted[lo - 1], address)) {
+		return _metal_memory_sorted[lo - 1];
+	}
 	return NULL;
 }
 
+struct metal_memory *metal_get_memory_from_address(const uintptr_t address) {
+	struct metal_memory *mem = __METAL_ACCESS_ONCE(&_metal_memory_last);
+
+	if(mem && _metal_memory_contains(mem, address)) {
+		return mem;
+	}
+
+	mem = _metal_memory_search(address);
+	if(mem) {
+		__METAL_ACCESS_ONCE(&_metal_memory_last) = mem;
+	}
+	return mem;
+}
+
+static int _metal_memory_attribute_bits(const struct metal_memory *mem) {
+	return (mem->_attrs.R ? METAL_MEMORY_READABLE : 0) |
+	       (mem->_attrs.W ? METAL_MEMORY_WRITABLE : 0) |
+	       (mem->_attrs.X ? METAL_MEMORY_EXECUTABLE : 0) |
+	       (mem->_attrs.C ? METAL_MEMORY_CACHEABLE : 0) |
+	       (mem->_attrs.A ? METAL_MEMORY_ATOMIC : 0);
+}
+
+int metal_memory_attributes(const uintptr_t address, size_t len) {
+	uintptr_t end = address + len;
+	uintptr_t cur = address;
+	int attrs = METAL_MEMORY_READABLE | METAL_MEMORY_WRITABLE |
+	            METAL_MEMORY_EXECUTABLE | METAL_MEMORY_CACHEABLE |
+	            METAL_MEMORY_ATOMIC;
+
+	if(len == 0) {
+		end = address + 1;
+	}
+	if(end < address) {
+		return -1;
+	}
+
+	/* Walk the blocks which cover the range, which may be several adjacent
+	 * ones */
+	do {
+		struct metal_memory *mem = metal_get_memory_from_address(cur);
+		uintptr_t mem_end;
+
+		if(!mem) {
+			return -1;
+		}
+		attrs &= _metal_memory_attribute_bits(mem);
+
+		mem_end = metal_memory_get_base_address(mem) + metal_memory_get_size(mem);
+		if(mem_end <= cur) {
+			/* The block reaches the top of the address space */
+			break;
+		}
+		cur = mem_end;
+	} while(cur < end);
+
+	return attrs;
+}
+
 extern __inline__ uintptr_t metal_memory_get_base_address(const struct metal_memory *memory);
 extern __inline__ size_t metal_memory_get_size(const struct metal_memory *memory);
 extern __inline__ int metal_memory_supports_atomics(const struct metal_memory *memory);
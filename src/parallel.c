@@ -0,0 +1,353 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <stdint.h>
+#include <metal/machine.h>
+#include <metal/machine/platform.h>
+#include <metal/io.h>
+#include <metal/drivers/riscv_cpu.h>
+#include <metal/mailbox.h>
+#include <metal/parallel.h>
+
+#ifdef __riscv_atomic
+
+#define METAL_REG(base, offset)   (((unsigned long)(base) + (offset)))
+#define METAL_REGW(base, offset)  (__METAL_ACCESS_ONCE((__metal_io_u32 *)METAL_REG((base), (offset))))
+#define METAL_MSIP(base, hart)    (METAL_REGW((base),4*(hart)))
+
+#if __riscv_xlen == 32
+#define _METAL_PARALLEL_AMOADD "amoadd.w.aqrl"
+#else
+#define _METAL_PARALLEL_AMOADD "amoadd.d.aqrl"
+#endif
+
+/* A single metal_parallel_for() call. Lives on the caller's stack until the
+ * last piece is complete. */
+struct _metal_parallel_job {
+    metal_parallel_fn fn;
+    void *arg;
+    unsigned long grain;
+    /* The number of indices which haven't been run yet */
+    unsigned long remaining;
+};
+
+struct _metal_parallel_range {
+    struct _metal_parallel_job *job;
+    unsigned long begin;
+    unsigned long end;
+};
+
+/* A Chase-Lev deque: the owning hart pushes and pops at the bottom, other
+ * harts steal from the top. The ranges array never grows. */
+struct _metal_parallel_deque {
+    /* Written by thieves */
+    unsigned int top __attribute__((aligned(64)));
+    /* Written by the owner */
+    unsigned int bottom __attribute__((aligned(64)));
+    struct _metal_parallel_range ranges[METAL_PARALLEL_DEQUE_SIZE];
+};
+
+/* Updated with AMOs like the locks, but zero-initialized and large, so they
+ * go in .bss.locks rather than take space in the .data load image. The name
+ * links the section with the rest of .bss, which supports AMOs wherever
+ * .data does. */
+__attribute__((section(".bss.locks")))
+static struct _metal_parallel_deque _metal_parallel_deques[__METAL_DT_MAX_HARTS];
+
+/* One bit per hart which is sleeping in metal_parallel_worker(), 32 harts to
+ * a word */
+#define _METAL_PARALLEL_IDLE_WORDS ((__METAL_DT_MAX_HARTS + 31) / 32)
+__attribute__((section(".data.locks")))
+static unsigned int _metal_parallel_idle[_METAL_PARALLEL_IDLE_WORDS];
+
+static uintptr_t _metal_parallel_msip_base(void)
+{
+#ifdef __METAL_DT_RISCV_CLINT0_HANDLE
+    return __metal_driver_sifive_clint0_control_base(__METAL_DT_RISCV_CLINT0_HANDLE)
+           + METAL_RISCV_CLINT0_MSIP_BASE;
+#elif defined(__METAL_DT_SIFIVE_CLIC0_HANDLE)
+    return __metal_driver_sifive_clic0_control_base(__METAL_DT_SIFIVE_CLIC0_HANDLE)
+           + METAL_SIFIVE_CLIC0_MSIP_BASE;
+#else
+    return 0;
+#endif
+}
+
+/* Compare-and-swap built from LR/SC, returns nonzero if the swap happened */
+static int _metal_parallel_cas(unsigned int *addr, unsigned int expected,
+                               unsigned int desired)
+{
+    int old, fail;
+
+    __asm__ volatile("1: lr.w.aqrl %[old], (%[addr])\n"
+                     "   bne %[old], %[expected], 2f\n"
+                     "   sc.w.rl %[fail], %[desired], (%[addr])\n"
+                     "   bnez %[fail], 1b\n"
+                     "2:"
+                     : [old] "=&r" (old), [fail] "=&r" (fail)
+                     : [addr] "r" (addr), [expected] "r" ((int)expected),
+                       [desired] "r" (desired)
+                     : "memory");
+
+    return old == (int)expected;
+}
+
+static int _metal_parallel_push(struct _metal_parallel_deque *dq,
+                                const struct _metal_parallel_range *range)
+{
+    unsigned int b = dq->bottom;
+    unsigned int t = __METAL_ACCESS_ONCE(&dq->top);
+
+    if (b - t >= METAL_PARALLEL_DEQUE_SIZE) {
+        return -1;
+    }
+
+    dq->ranges[b & (METAL_PARALLEL_DEQUE_SIZE - 1)] = *range;
+    __METAL_IO_FENCE(rw, w)
+    __METAL_ACCESS_ONCE(&dq->bottom) = b + 1;
+
+    return 0;
+}
+
+static int _metal_parallel_pop(struct _metal_parallel_deque *dq,
+                               struct _metal_parallel_range *range)
+{
+    unsigned int b = dq->bottom - 1;
+    unsigned int t;
+    int ok = 1;
+
+    __METAL_ACCESS_ONCE(&dq->bottom) = b;
+    /* The store to bottom must be visible before top is read, or a thief and
+     * the owner could both take the last range */
+    __METAL_IO_FENCE(rw, rw)
+    t = __METAL_ACCESS_ONCE(&dq->top);
+
+    if ((int)(b - t) < 0) {
+        /* Empty */
+        __METAL_ACCESS_ONCE(&dq->bottom) = b + 1;
+        return 0;
+    }
+
+    *range = dq->ranges[b & (METAL_PARALLEL_DEQUE_SIZE - 1)];
+    if (b == t) {
+        /* The last range, race the thieves for it */
+        ok = _metal_parallel_cas(&dq->top, t, t + 1);
+        __METAL_ACCESS_ONCE(&dq->bottom) = b + 1;
+    }
+
+    return ok;
+}
+
+static int _metal_parallel_steal(struct _metal_parallel_deque *dq,
+                                 struct _metal_parallel_range *range)
+{
+    unsigned int t = __METAL_ACCESS_ONCE(&dq->top);
+    unsigned int b;
+
+    __METAL_IO_FENCE(rw, rw)
+    b = __METAL_ACCESS_ONCE(&dq->bottom);
+
+    if ((int)(b - t) <= 0) {
+        return 0;
+    }
+
+    __METAL_IO_FENCE(r, r)
+    *range = dq->ranges[t & (METAL_PARALLEL_DEQUE_SIZE - 1)];
+
+    return _metal_parallel_cas(&dq->top, t, t + 1);
+}
+
+static int _metal_parallel_steal_any(int hartid, struct _metal_parallel_range *range)
+{
+    /* Start with the next hart along so thieves spread out */
+    for (int i = 1; i < __METAL_DT_MAX_HARTS; i++) {
+        int victim = (hartid + i) % __METAL_DT_MAX_HARTS;
+
+        if (_metal_parallel_steal(&_metal_parallel_deques[victim], range)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Wake one sleeping worker, if there is one */
+static void _metal_parallel_wake(void)
+{
+    unsigned int idle, bit, old;
+
+    /* Order the push before the check, pairs with the worker setting its idle
+     * bit before looking for work one last time */
+    __METAL_IO_FENCE(rw, rw)
+    for (int i = 0; i < _METAL_PARALLEL_IDLE_WORDS; i++) {
+        idle = __METAL_ACCESS_ONCE(&_metal_parallel_idle[i]);
+        if (!idle) {
+            continue;
+        }
+
+        /* Claim the hart by clearing its bit, so the next push wakes
+         * another */
+        bit = idle & -idle;
+        __asm__ volatile("amoand.w.aqrl %[old], %[mask], (%[idle])"
+                         : [old] "=r" (old)
+                         : [mask] "r" (~bit), [idle] "r" (&_metal_parallel_idle[i])
+                         : "memory");
+        if (old & bit) {
+            METAL_MSIP(_metal_parallel_msip_base(), 32 * i + __builtin_ctz(bit)) = 1;
+        }
+        return;
+    }
+}
+
+static void _metal_parallel_run(int hartid, struct _metal_parallel_range *range)
+{
+    struct _metal_parallel_job *job = range->job;
+    unsigned long begin = range->begin;
+    unsigned long end = range->end;
+    unsigned long done;
+
+    /* Offer the upper half to other harts until the piece is small enough */
+    while (end - begin > job->grain) {
+        struct _metal_parallel_range upper;
+
+        upper.job = job;
+        upper.begin = begin + (end - begin) / 2;
+        upper.end = end;
+
+        if (_metal_parallel_push(&_metal_parallel_deques[hartid], &upper)) {
+            break;
+        }
+        _metal_parallel_wake();
+
+        end = upper.begin;
+    }
+
+    job->fn(begin, end, job->arg);
+
+    /* After this, the job may go out of scope on the hart which started it */
+    __asm__ volatile(_METAL_PARALLEL_AMOADD " %[done], %[count], (%[remaining])"
+                     : [done] "=r" (done)
+                     : [count] "r" (-(end - begin)), [remaining] "r" (&job->remaining)
+                     : "memory");
+}
+
+int metal_parallel_for(unsigned long begin, unsigned long end,
+                       unsigned long grain, metal_parallel_fn fn, void *arg)
+{
+    struct _metal_parallel_job job;
+    struct _metal_parallel_range range;
+    int hartid = __metal_current_hartid();
+
+    if (end <= begin) {
+        return 0;
+    }
+
+    job.fn = fn;
+    job.arg = arg;
+    job.grain = grain ? grain : 1;
+    job.remaining = end - begin;
+
+    range.job = &job;
+    range.begin = begin;
+    range.end = end;
+
+    _metal_parallel_run(hartid, &range);
+
+    /* Help out until every piece of this job is complete. The pieces run here
+     * may belong to other jobs, which is fine. */
+    while (__METAL_ACCESS_ONCE(&job.remaining)) {
+        if (_metal_parallel_pop(&_metal_parallel_deques[hartid], &range) ||
+            _metal_parallel_steal_any(hartid, &range)) {
+            _metal_parallel_run(hartid, &range);
+        }
+    }
+    __METAL_IO_FENCE(r, rw)
+
+    return 0;
+}
+
+void metal_parallel_worker(void)
+{
+    int hartid = __metal_current_hartid();
+    unsigned int bit = 1U << (hartid % 32);
+    unsigned int *idle = &_metal_parallel_idle[hartid / 32];
+    uintptr_t msip_base = _metal_parallel_msip_base();
+    struct _metal_parallel_range range;
+    unsigned long mstatus;
+
+    /* Work runs with interrupts enabled, so the hart keeps taking its timer,
+     * external and mailbox interrupts, and only the sleep below turns them
+     * off. Enabling the mailbox sets up this hart's interrupt controller.
+     * Without one, interrupts stay as the caller left them. */
+    __asm__ volatile("csrr %0, mstatus" : "=r" (mstatus));
+    if (metal_mailbox_enable() == 0) {
+        mstatus |= METAL_MSTATUS_MIE;
+    }
+    __asm__ volatile("csrs mie, %0" :: "r" (METAL_LOCAL_INTERRUPT_SW));
+    __metal_irq_restore(mstatus);
+
+    while (1) {
+        if (_metal_parallel_pop(&_metal_parallel_deques[hartid], &range) ||
+            _metal_parallel_steal_any(hartid, &range)) {
+            _metal_parallel_run(hartid, &range);
+            continue;
+        }
+
+        if (!msip_base) {
+            /* No way to be woken up, so keep polling */
+            continue;
+        }
+
+        /* Sleep until a software interrupt is pending, without taking it */
+        __asm__ volatile("csrc mstatus, %0" :: "r" (METAL_MSTATUS_MIE) : "memory");
+        __asm__ volatile("amoor.w.aqrl zero, %[bit], (%[idle])"
+                         :: [bit] "r" (bit), [idle] "r" (idle)
+                         : "memory");
+
+        /* Work pushed before the idle bit was visible didn't wake anyone, so
+         * look once more before going to sleep */
+        if (_metal_parallel_steal_any(hartid, &range)) {
+            __asm__ volatile("amoand.w.aqrl zero, %[mask], (%[idle])"
+                             :: [mask] "r" (~bit), [idle] "r" (idle)
+                             : "memory");
+            __metal_irq_restore(mstatus);
+            _metal_parallel_run(hartid, &range);
+            continue;
+        }
+
+        while (METAL_MSIP(msip_base, hartid) == 0) {
+            __asm__ volatile("wfi");
+        }
+        METAL_MSIP(msip_base, hartid) = 0;
+
+        /* The interrupt is never taken here, so the mailbox never sees it.
+         * Run its calls, which also lets the next one posted raise the
+         * interrupt again. */
+        metal_mailbox_poll();
+
+        __asm__ volatile("amoand.w.aqrl zero, %[mask], (%[idle])"
+                         :: [mask] "r" (~bit), [idle] "r" (idle)
+                         : "memory");
+        __metal_irq_restore(mstatus);
+    }
+}
+
+#else /* !__riscv_atomic */
+
+/* Without atomics the deques can't be shared, so run the loop in place */
+int metal_parallel_for(unsigned long begin, unsigned long end,
+                       unsigned long grain, metal_parallel_fn fn, void *arg)
+{
+    if (end > begin) {
+        fn(begin, end, arg);
+    }
+    return 0;
+}
+
+void metal_parallel_worker(void)
+{
+    while (1) {
+        __asm__ volatile("wfi");
+    }
+}
+
+#endif /* __riscv_atomic */
@@ -0,0 +1,196 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <stdint.h>
+#include <metal/machine.h>
+#include <metal/io.h>
+#include <metal/drivers/riscv_cpu.h>
+#include <metal/pool.h>
+
+/* Without atomics there is only one hart, and disabling interrupts is
+ * enough */
+static void _metal_pool_lock(struct metal_pool *pool)
+{
+#ifdef __riscv_atomic
+    metal_lock_take(&pool->_lock);
+#endif
+}
+
+static void _metal_pool_unlock(struct metal_pool *pool)
+{
+#ifdef __riscv_atomic
+    metal_lock_give(&pool->_lock);
+#endif
+}
+
+/* Count objects leaving and returning to the pool. Interrupts are disabled,
+ * but other harts may be counting too. */
+static void _metal_pool_count_alloc(struct metal_pool *pool)
+{
+#ifdef __riscv_atomic
+    unsigned int in_use;
+
+    __asm__ volatile("amoadd.w %[old], %[one], (%[in_use])"
+                     : [old] "=r" (in_use)
+                     : [one] "r" (1), [in_use] "r" (&pool->_in_use)
+                     : "memory");
+    __asm__ volatile("amomaxu.w zero, %[val], (%[high])"
+                     :: [val] "r" (in_use + 1), [high] "r" (&pool->_high_water)
+                     : "memory");
+#else
+    if (++pool->_in_use > pool->_high_water) {
+        pool->_high_water = pool->_in_use;
+    }
+#endif
+}
+
+static void _metal_pool_count_free(struct metal_pool *pool)
+{
+#ifdef __riscv_atomic
+    __asm__ volatile("amoadd.w zero, %[one], (%[in_use])"
+                     :: [one] "r" (-1), [in_use] "r" (&pool->_in_use)
+                     : "memory");
+#else
+    pool->_in_use--;
+#endif
+}
+
+/* The number of free objects held in magazines. Other harts change their own
+ * magazines without the lock, so this is only a snapshot. */
+static unsigned int _metal_pool_cached(struct metal_pool *pool)
+{
+    unsigned int cached = 0;
+
+    for (int i = 0; i < __METAL_DT_MAX_HARTS; i++) {
+        cached += __METAL_ACCESS_ONCE(&pool->_mags[i]._count);
+    }
+    return cached;
+}
+
+int metal_pool_init(struct metal_pool *pool, void *storage, size_t obj_size,
+                    unsigned int count)
+{
+    unsigned char *obj;
+
+    if (!storage || ((uintptr_t)storage & (_METAL_POOL_ALIGN - 1))) {
+        return -1;
+    }
+#ifdef __riscv_atomic
+    if (metal_lock_init(&pool->_lock)) {
+        return -1;
+    }
+#endif
+
+    pool->_storage = storage;
+    pool->_stride = _METAL_POOL_STRIDE(obj_size ? obj_size : 1);
+    pool->_count = count;
+    pool->_in_use = 0;
+    pool->_high_water = 0;
+    pool->_failures = 0;
+    pool->_stranded = 0;
+
+    pool->_mag_size = count / (2 * __METAL_DT_MAX_HARTS);
+    if (pool->_mag_size > METAL_POOL_MAGAZINE_SIZE) {
+        pool->_mag_size = METAL_POOL_MAGAZINE_SIZE;
+    }
+    for (int i = 0; i < __METAL_DT_MAX_HARTS; i++) {
+        pool->_mags[i]._count = 0;
+    }
+
+    /* Thread the free list through the objects in address order */
+    pool->_free = NULL;
+    obj = pool->_storage + (size_t)count * pool->_stride;
+    while (obj > pool->_storage) {
+        obj -= pool->_stride;
+        *(void **)obj = pool->_free;
+        pool->_free = obj;
+    }
+
+    return 0;
+}
+
+void *metal_pool_alloc(struct metal_pool *pool)
+{
+    int hartid = __metal_current_hartid();
+    struct _metal_pool_magazine *mag = NULL;
+    unsigned long mstatus;
+    void *obj = NULL;
+
+    mstatus = __metal_irq_save();
+
+    if (pool->_mag_size && hartid < __METAL_DT_MAX_HARTS) {
+        mag = &pool->_mags[hartid];
+    }
+
+    if (mag && mag->_count) {
+        obj = mag->_objs[--mag->_count];
+    } else {
+        _metal_pool_lock(pool);
+        obj = pool->_free;
+        if (obj) {
+            pool->_free = *(void **)obj;
+            /* Refill half the magazine while the lock is held */
+            while (mag && pool->_free && mag->_count < pool->_mag_size / 2) {
+                mag->_objs[mag->_count++] = pool->_free;
+                pool->_free = *(void **)pool->_free;
+            }
+        } else if (_metal_pool_cached(pool)) {
+            pool->_stranded++;
+        } else {
+            pool->_failures++;
+        }
+        _metal_pool_unlock(pool);
+    }
+
+    if (obj) {
+        _metal_pool_count_alloc(pool);
+    }
+
+    __metal_irq_restore(mstatus);
+    return obj;
+}
+
+void metal_pool_free(struct metal_pool *pool, void *obj)
+{
+    int hartid = __metal_current_hartid();
+    struct _metal_pool_magazine *mag = NULL;
+    unsigned long mstatus;
+
+    if (!obj) {
+        return;
+    }
+
+    mstatus = __metal_irq_save();
+    _metal_pool_count_free(pool);
+
+    if (pool->_mag_size && hartid < __METAL_DT_MAX_HARTS) {
+        mag = &pool->_mags[hartid];
+    }
+
+    if (mag && mag->_count < pool->_mag_size) {
+        mag->_objs[mag->_count++] = obj;
+    } else {
+        _metal_pool_lock(pool);
+        *(void **)obj = pool->_free;
+        pool->_free = obj;
+        /* Empty half the magazine while the lock is held */
+        while (mag && mag->_count > pool->_mag_size / 2) {
+            void *spare = mag->_objs[--mag->_count];
+
+            *(void **)spare = pool->_free;
+            pool->_free = spare;
+        }
+        _metal_pool_unlock(pool);
+    }
+
+    __metal_irq_restore(mstatus);
+}
+
+void metal_pool_get_stats(struct metal_pool *pool, struct metal_pool_stats *stats)
+{
+    stats->count = pool->_count;
+    stats->in_use = __METAL_ACCESS_ONCE(&pool->_in_use);
+    stats->high_water = __METAL_ACCESS_ONCE(&pool->_high_water);
+    stats->failures = __METAL_ACCESS_ONCE(&pool->_failures);
+    stats->stranded = __METAL_ACCESS_ONCE(&pool->_stranded);
+}
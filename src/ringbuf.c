@@ -0,0 +1,351 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <string.h>
+#include <metal/io.h>
+#include <metal/ringbuf.h>
+
+/* Orders the element accesses before the index store which hands them over */
+#define _METAL_RINGBUF_RELEASE() __METAL_IO_FENCE(rw, w)
+/* Orders the index load before the element accesses it allows */
+#define _METAL_RINGBUF_ACQUIRE() __METAL_IO_FENCE(r, rw)
+
+static void _metal_ringbuf_copy_in(unsigned char *buffer, unsigned int mask,
+                                   size_t elem_size, unsigned int pos,
+                                   const unsigned char *src, unsigned int count)
+{
+    unsigned int idx = pos & mask;
+    unsigned int first = mask + 1 - idx;
+
+    if (first > count) {
+        first = count;
+    }
+    memcpy(buffer + (idx * elem_size), src, first * elem_size);
+    memcpy(buffer, src + (first * elem_size), (count - first) * elem_size);
+}
+
+static void _metal_ringbuf_copy_out(const unsigned char *buffer, unsigned int mask,
+                                    size_t elem_size, unsigned int pos,
+                                    unsigned char *dst, unsigned int count)
+{
+    unsigned int idx = pos & mask;
+    unsigned int first = mask + 1 - idx;
+
+    if (first > count) {
+        first = count;
+    }
+    memcpy(dst, buffer + (idx * elem_size), first * elem_size);
+    memcpy(dst + (first * elem_size), buffer, (count - first) * elem_size);
+}
+
+int metal_spsc_ringbuf_init(struct metal_spsc_ringbuf *rb, void *buffer,
+                            size_t elem_size, unsigned int capacity)
+{
+    if (!rb || !buffer || !elem_size || !capacity || (capacity & (capacity - 1))) {
+        return -1;
+    }
+
+    rb->_head = 0;
+    rb->_cached_tail = 0;
+    rb->_tail = 0;
+    rb->_cached_head = 0;
+    rb->_buffer = buffer;
+    rb->_elem_size = elem_size;
+    rb->_mask = capacity - 1;
+
+    return 0;
+}
+
+/* Returns the number of free elements, refreshing the consumer index only
+ * when the cached copy says there isn't enough room. */
+static unsigned int _metal_spsc_ringbuf_free(struct metal_spsc_ringbuf *rb,
+                                             unsigned int wanted)
+{
+    unsigned int free = rb->_mask + 1 - (rb->_head - rb->_cached_tail);
+
+    if (free < wanted) {
+        rb->_cached_tail = __METAL_ACCESS_ONCE(&rb->_tail);
+        _METAL_RINGBUF_ACQUIRE();
+        free = rb->_mask + 1 - (rb->_head - rb->_cached_tail);
+    }
+    return free;
+}
+
+/* Returns the number of used elements, refreshing the producer index only
+ * when the cached copy says there aren't enough. */
+static unsigned int _metal_spsc_ringbuf_used(struct metal_spsc_ringbuf *rb,
+                                             unsigned int wanted)
+{
+    unsigned int used = rb->_cached_head - rb->_tail;
+
+    if (used < wanted) {
+        rb->_cached_head = __METAL_ACCESS_ONCE(&rb->_head);
+        _METAL_RINGBUF_ACQUIRE();
+        used = rb->_cached_head - rb->_tail;
+    }
+    return used;
+}
+
+unsigned int metal_spsc_ringbuf_enqueue(struct metal_spsc_ringbuf *rb,
+                                        const void *elems, unsigned int count)
+{
+    unsigned int free = _metal_spsc_ringbuf_free(rb, count);
+
+    if (count > free) {
+        count = free;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    _metal_ringbuf_copy_in(rb->_buffer, rb->_mask, rb->_elem_size,
+                           rb->_head, elems, count);
+
+    _METAL_RINGBUF_RELEASE();
+    __METAL_ACCESS_ONCE(&rb->_head) = rb->_head + count;
+
+    return count;
+}
+
+unsigned int metal_spsc_ringbuf_dequeue(struct metal_spsc_ringbuf *rb,
+                                        void *elems, unsigned int count)
+{
+    unsigned int used = _metal_spsc_ringbuf_used(rb, count);
+
+    if (count > used) {
+        count = used;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    _metal_ringbuf_copy_out(rb->_buffer, rb->_mask, rb->_elem_size,
+                            rb->_tail, elems, count);
+
+    _METAL_RINGBUF_RELEASE();
+    __METAL_ACCESS_ONCE(&rb->_tail) = rb->_tail + count;
+
+    return count;
+}
+
+unsigned int metal_spsc_ringbuf_reserve(struct metal_spsc_ringbuf *rb, void **elems)
+{
+    unsigned int idx = rb->_head & rb->_mask;
+    unsigned int contiguous = rb->_mask + 1 - idx;
+    unsigned int free = _metal_spsc_ringbuf_free(rb, contiguous);
+
+    *elems = rb->_buffer + (idx * rb->_elem_size);
+
+    return (free < contiguous) ? free : contiguous;
+}
+
+void metal_spsc_ringbuf_commit(struct metal_spsc_ringbuf *rb, unsigned int count)
+{
+    _METAL_RINGBUF_RELEASE();
+    __METAL_ACCESS_ONCE(&rb->_head) = rb->_head + count;
+}
+
+unsigned int metal_spsc_ringbuf_peek(struct metal_spsc_ringbuf *rb, void **elems)
+{
+    unsigned int idx = rb->_tail & rb->_mask;
+    unsigned int contiguous = rb->_mask + 1 - idx;
+    unsigned int used = _metal_spsc_ringbuf_used(rb, contiguous);
+
+    *elems = rb->_buffer + (idx * rb->_elem_size);
+
+    return (used < contiguous) ? used : contiguous;
+}
+
+void metal_spsc_ringbuf_consume(struct metal_spsc_ringbuf *rb, unsigned int count)
+{
+    _METAL_RINGBUF_RELEASE();
+    __METAL_ACCESS_ONCE(&rb->_tail) = rb->_tail + count;
+}
+
+extern __inline__ unsigned int metal_spsc_ringbuf_count(struct metal_spsc_ringbuf *rb);
+
+#ifdef __riscv_atomic
+
+/* Compare-and-swap built from LR/SC, returns nonzero if the swap happened */
+static int _metal_ringbuf_cas(unsigned int *addr, unsigned int expected,
+                              unsigned int desired)
+{
+    int old, fail;
+
+    __asm__ volatile("1: lr.w.aq %[old], (%[addr])\n"
+                     "   bne %[old], %[expected], 2f\n"
+                     "   sc.w.rl %[fail], %[desired], (%[addr])\n"
+                     "   bnez %[fail], 1b\n"
+                     "2:"
+                     : [old] "=&r" (old), [fail] "=&r" (fail)
+                     : [addr] "r" (addr), [expected] "r" ((int)expected),
+                       [desired] "r" (desired)
+                     : "memory");
+
+    return old == (int)expected;
+}
+
+int metal_mpmc_ringbuf_init(struct metal_mpmc_ringbuf *rb, void *buffer,
+                            unsigned int *seq, size_t elem_size,
+                            unsigned int capacity)
+{
+    if (!rb || !buffer || !seq || !elem_size || !capacity ||
+        (capacity & (capacity - 1))) {
+        return -1;
+    }
+
+    /* Each slot's sequence number says which lap of the ring it expects
+     * next: pos when it is free to fill, pos + 1 when it holds data. */
+    for (unsigned int i = 0; i < capacity; i++) {
+        seq[i] = i;
+    }
+
+    rb->_enqueue_pos = 0;
+    rb->_dequeue_pos = 0;
+    rb->_seq = seq;
+    rb->_buffer = buffer;
+    rb->_elem_size = elem_size;
+    rb->_mask = capacity - 1;
+
+    _METAL_RINGBUF_RELEASE();
+
+    return 0;
+}
+
+void *metal_mpmc_ringbuf_reserve(struct metal_mpmc_ringbuf *rb, unsigned int *ticket)
+{
+    unsigned int pos = __METAL_ACCESS_ONCE(&rb->_enqueue_pos);
+
+    while (1) {
+        unsigned int seq = __METAL_ACCESS_ONCE(&rb->_seq[pos & rb->_mask]);
+        int diff = (int)(seq - pos);
+
+        if (diff == 0) {
+            if (_metal_ringbuf_cas(&rb->_enqueue_pos, pos, pos + 1)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        }
+        pos = __METAL_ACCESS_ONCE(&rb->_enqueue_pos);
+    }
+
+    _METAL_RINGBUF_ACQUIRE();
+
+    *ticket = pos;
+    return rb->_buffer + ((pos & rb->_mask) * rb->_elem_size);
+}
+
+void metal_mpmc_ringbuf_commit(struct metal_mpmc_ringbuf *rb, unsigned int ticket)
+{
+    _METAL_RINGBUF_RELEASE();
+    __METAL_ACCESS_ONCE(&rb->_seq[ticket & rb->_mask]) = ticket + 1;
+}
+
+void *metal_mpmc_ringbuf_peek(struct metal_mpmc_ringbuf *rb, unsigned int *ticket)
+{
+    unsigned int pos = __METAL_ACCESS_ONCE(&rb->_dequeue_pos);
+
+    while (1) {
+        unsigned int seq = __METAL_ACCESS_ONCE(&rb->_seq[pos & rb->_mask]);
+        int diff = (int)(seq - (pos + 1));
+
+        if (diff == 0) {
+            if (_metal_ringbuf_cas(&rb->_dequeue_pos, pos, pos + 1)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        }
+        pos = __METAL_ACCESS_ONCE(&rb->_dequeue_pos);
+    }
+
+    _METAL_RINGBUF_ACQUIRE();
+
+    *ticket = pos;
+    return rb->_buffer + ((pos & rb->_mask) * rb->_elem_size);
+}
+
+void metal_mpmc_ringbuf_consume(struct metal_mpmc_ringbuf *rb, unsigned int ticket)
+{
+    _METAL_RINGBUF_RELEASE();
+    __METAL_ACCESS_ONCE(&rb->_seq[ticket & rb->_mask]) = ticket + rb->_mask + 1;
+}
+
+unsigned int metal_mpmc_ringbuf_enqueue(struct metal_mpmc_ringbuf *rb,
+                                        const void *elems, unsigned int count)
+{
+    const unsigned char *src = elems;
+    unsigned int done;
+
+    for (done = 0; done < count; done++) {
+        unsigned int ticket;
+        void *slot = metal_mpmc_ringbuf_reserve(rb, &ticket);
+
+        if (!slot) {
+            break;
+        }
+        memcpy(slot, src + (done * rb->_elem_size), rb->_elem_size);
+        metal_mpmc_ringbuf_commit(rb, ticket);
+    }
+
+    return done;
+}
+
+unsigned int metal_mpmc_ringbuf_dequeue(struct metal_mpmc_ringbuf *rb,
+                                        void *elems, unsigned int count)
+{
+    unsigned char *dst = elems;
+    unsigned int done;
+
+    for (done = 0; done < count; done++) {
+        unsigned int ticket;
+        void *slot = metal_mpmc_ringbuf_peek(rb, &ticket);
+
+        if (!slot) {
+            break;
+        }
+        memcpy(dst + (done * rb->_elem_size), slot, rb->_elem_size);
+        metal_mpmc_ringbuf_consume(rb, ticket);
+    }
+
+    return done;
+}
+
+#else /* !__riscv_atomic */
+
+/* Without atomics there is no safe way to share a ring between producers */
+int metal_mpmc_ringbuf_init(struct metal_mpmc_ringbuf *rb, void *buffer,
+                            unsigned int *seq, size_t elem_size,
+                            unsigned int capacity)
+{
+    return 3;
+}
+
+void *metal_mpmc_ringbuf_reserve(struct metal_mpmc_ringbuf *rb, unsigned int *ticket)
+{
+    return NULL;
+}
+
+void metal_mpmc_ringbuf_commit(struct metal_mpmc_ringbuf *rb, unsigned int ticket) { }
+
+void *metal_mpmc_ringbuf_peek(struct metal_mpmc_ringbuf *rb, unsigned int *ticket)
+{
+    return NULL;
+}
+
+void metal_mpmc_ringbuf_consume(struct metal_mpmc_ringbuf *rb, unsigned int ticket) { }
+
+unsigned int metal_mpmc_ringbuf_enqueue(struct metal_mpmc_ringbuf *rb,
+                                        const void *elems, unsigned int count)
+{
+    return 0;
+}
+
+unsigned int metal_mpmc_ringbuf_dequeue(struct metal_mpmc_ringbuf *rb,
+                                        void *elems, unsigned int count)
+{
+    return 0;
+}
+
+#endif /* __riscv_atomic */
@@ -0,0 +1,739 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <stdint.h>
+#include <metal/machine.h>
+#include <metal/io.h>
+#include <metal/cpu.h>
+#include <metal/interrupt.h>
+#include <metal/drivers/riscv_cpu.h>
+#include <metal/lock.h>
+#include <metal/shutdown.h>
+#include <metal/swtimer.h>
+#include <metal/timer.h>
+#include <metal/sched.h>
+
+#if METAL_SCHED_PRIORITIES > 32
+#error "METAL_SCHED_PRIORITIES must be at most 32"
+#endif
+
+#define _METAL_SCHED_READY     0
+#define _METAL_SCHED_RUNNING   1
+#define _METAL_SCHED_BLOCKED   2
+#define _METAL_SCHED_DONE      3
+
+/* Why a task trapped into the scheduler with ecall */
+#define _METAL_SCHED_REQ_NONE    0
+#define _METAL_SCHED_REQ_YIELD   1
+#define _METAL_SCHED_REQ_SUSPEND 2
+#define _METAL_SCHED_REQ_EXIT    3
+
+#define _METAL_SCHED_ECALL_M 11
+
+/* Must match the trap frame saved by _metal_sched_trap_entry in
+ * sched_switch.S */
+#define _METAL_SCHED_FRAME_SIZE    (32 * sizeof(unsigned long))
+#define _METAL_SCHED_FRAME_MEPC    0
+#define _METAL_SCHED_FRAME_RA      1
+#define _METAL_SCHED_FRAME_MSTATUS 2
+#define _METAL_SCHED_FRAME_A0      10
+
+#define _METAL_SCHED_MSTATUS_FS (METAL_MSTATUS_FS_DIRTY)
+
+struct _metal_sched_hart {
+    struct metal_cpu *cpu;
+    struct metal_sched_task *current;
+    /* Stands in for the context which called metal_sched_start() */
+    struct metal_sched_task idle;
+    /* One FIFO per priority, and a bit set for each non-empty one */
+    struct metal_sched_task *head[METAL_SCHED_PRIORITIES];
+    struct metal_sched_task *tail[METAL_SCHED_PRIORITIES];
+    unsigned int ready;
+    struct metal_swtimer slice;
+    int slice_expired;
+    int need_resched;
+    int request;
+    int in_trap;
+    int started;
+#ifdef __riscv_flen
+    /* The task whose state is in the FP registers, if it was ever saved */
+    struct metal_sched_task *fp_owner;
+#endif
+};
+
+static struct _metal_sched_hart _metal_sched_harts[__METAL_DT_MAX_HARTS];
+
+/* Protect each hart's ready queues against other harts */
+__attribute__((section(".data.locks")))
+static int _metal_sched_locks[__METAL_DT_MAX_HARTS];
+
+void _metal_sched_trap_entry(void);
+void *_metal_sched_trap(void *frame);
+#ifdef __riscv_flen
+void _metal_sched_fp_save(unsigned long long *fp);
+void _metal_sched_fp_restore(const unsigned long long *fp);
+#endif
+
+/* Called with interrupts disabled */
+static void _metal_sched_lock(int hartid)
+{
+#ifdef __riscv_atomic
+    int old;
+
+    do {
+        __asm__ volatile("amoswap.w.aq %[old], %[one], (%[lock])"
+                         : [old] "=r" (old)
+                         : [one] "r" (1), [lock] "r" (&_metal_sched_locks[hartid])
+                         : "memory");
+    } while (old);
+#endif
+}
+
+static void _metal_sched_unlock(int hartid)
+{
+#ifdef __riscv_atomic
+    __asm__ volatile("amoswap.w.rl x0, x0, (%[lock])"
+                     :: [lock] "r" (&_metal_sched_locks[hartid])
+                     : "memory");
+#endif
+}
+
+static void _metal_sched_enqueue(struct _metal_sched_hart *hart,
+                                 struct metal_sched_task *task, int at_head)
+{
+    int prio = task->_prio;
+
+    task->_state = _METAL_SCHED_READY;
+    if (!hart->head[prio]) {
+        task->_next = task->_prev = NULL;
+        hart->head[prio] = hart->tail[prio] = task;
+        hart->ready |= 1U << prio;
+    } else if (at_head) {
+        task->_prev = NULL;
+        task->_next = hart->head[prio];
+        hart->head[prio]->_prev = task;
+        hart->head[prio] = task;
+    } else {
+        task->_next = NULL;
+        task->_prev = hart->tail[prio];
+        hart->tail[prio]->_next = task;
+        hart->tail[prio] = task;
+    }
+}
+
+static void _metal_sched_dequeue(struct _metal_sched_hart *hart,
+                                 struct metal_sched_task *task)
+{
+    int prio = task->_prio;
+
+    if (task->_prev) {
+        task->_prev->_next = task->_next;
+    } else {
+        hart->head[prio] = task->_next;
+    }
+    if (task->_next) {
+        task->_next->_prev = task->_prev;
+    } else {
+        hart->tail[prio] = task->_prev;
+    }
+    if (!hart->head[prio]) {
+        hart->ready &= ~(1U << prio);
+    }
+    task->_next = task->_prev = NULL;
+}
+
+static int _metal_sched_top(struct _metal_sched_hart *hart)
+{
+    return hart->ready ? 31 - __builtin_clz(hart->ready) : -1;
+}
+
+/* Make a hart look at its ready queues again. Called with interrupts
+ * disabled. */
+static void _metal_sched_kick(int hartid)
+{
+    struct _metal_sched_hart *hart = &_metal_sched_harts[hartid];
+
+    hart->need_resched = 1;
+    if (hartid != __metal_current_hartid() || !hart->in_trap) {
+        /* Either another hart, or this one outside of the trap path. The
+         * software interrupt gets us into the trap path as soon as
+         * interrupts are enabled. */
+        metal_cpu_software_set_ipi(hart->cpu, hartid);
+    }
+}
+
+/* Change the effective priority of a task. Called with interrupts disabled
+ * and the task's hart locked. */
+static void _metal_sched_reprioritize(struct metal_sched_task *task, int prio)
+{
+    struct _metal_sched_hart *hart = &_metal_sched_harts[task->_hartid];
+
+    if (task->_prio == prio) {
+        return;
+    }
+
+    if (task->_state == _METAL_SCHED_READY) {
+        _metal_sched_dequeue(hart, task);
+        task->_prio = prio;
+        _metal_sched_enqueue(hart, task, 0);
+    } else {
+        task->_prio = prio;
+    }
+
+    if (hart->started) {
+        _metal_sched_kick(task->_hartid);
+    }
+}
+
+/* Choose the task to run next. Called in the trap path with the hart
+ * locked. */
+static struct metal_sched_task *_metal_sched_pick(struct _metal_sched_hart *hart,
+                                                  int request)
+{
+    struct metal_sched_task *cur = hart->current;
+    struct metal_sched_task *next;
+    int slice = hart->slice_expired;
+    int top;
+
+    hart->slice_expired = 0;
+
+    if (cur != &hart->idle) {
+        /* Drop a priority inherited through a lock which has since been
+         * given back */
+        if (cur->_locks_held == 0) {
+            cur->_prio = cur->_base_prio;
+        }
+
+        if (request == _METAL_SCHED_REQ_SUSPEND) {
+            if (cur->_resume_pending) {
+                cur->_resume_pending = 0;
+            } else {
+                cur->_state = _METAL_SCHED_BLOCKED;
+            }
+        } else if (request == _METAL_SCHED_REQ_EXIT) {
+            cur->_state = _METAL_SCHED_DONE;
+        }
+
+        if (cur->_state == _METAL_SCHED_RUNNING) {
+            top = _metal_sched_top(hart);
+
+            if (top > cur->_prio) {
+                /* Preempted, so it goes back to the front of the line */
+                _metal_sched_enqueue(hart, cur, 1);
+            } else if (top == cur->_prio &&
+                       (slice || request == _METAL_SCHED_REQ_YIELD)) {
+                _metal_sched_enqueue(hart, cur, 0);
+            } else {
+                return cur;
+            }
+        }
+    }
+
+    top = _metal_sched_top(hart);
+    if (top < 0) {
+        return &hart->idle;
+    }
+
+    next = hart->head[top];
+    _metal_sched_dequeue(hart, next);
+    next->_state = _METAL_SCHED_RUNNING;
+
+    /* Timers may only be cancelled on the hart which started them, so a
+     * task resumed from another hart has its timer cancelled here, before
+     * it can sleep again */
+    if (next->_cancel_pending) {
+        next->_cancel_pending = 0;
+        metal_swtimer_cancel(&next->_timer);
+    }
+
+    return next;
+}
+
+/* A task has overflowed if any word of the guard band at the bottom of its
+ * stack was written, or if its next trap frame would no longer fit above the
+ * bottom of the stack */
+static int _metal_sched_stack_overflowed(struct metal_sched_task *task)
+{
+    unsigned int *guard = (unsigned int *)task->_stack;
+
+    if ((unsigned char *)task->_sp < task->_stack + _METAL_SCHED_FRAME_SIZE) {
+        return 1;
+    }
+    for (size_t i = 0; i < METAL_SCHED_STACK_GUARD / sizeof(unsigned int); i++) {
+        if (guard[i] != (unsigned int)METAL_SCHED_STACK_FILL) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void _metal_sched_switch_out(struct _metal_sched_hart *hart,
+                                    struct metal_sched_task *task)
+{
+#ifdef __riscv_flen
+    unsigned long *frame = task->_sp;
+
+    /* Lazily save the FP registers, only if the task changed them */
+    if ((frame[_METAL_SCHED_FRAME_MSTATUS] & _METAL_SCHED_MSTATUS_FS) ==
+        METAL_MSTATUS_FS_DIRTY) {
+        _metal_sched_fp_save(task->_fp);
+        task->_fp_valid = 1;
+        hart->fp_owner = task;
+        frame[_METAL_SCHED_FRAME_MSTATUS] &= ~_METAL_SCHED_MSTATUS_FS;
+        frame[_METAL_SCHED_FRAME_MSTATUS] |= METAL_MSTATUS_FS_CLEAN;
+    }
+#endif
+
+    if (task->_stack && task->_state != _METAL_SCHED_DONE &&
+        _metal_sched_stack_overflowed(task)) {
+        metal_sched_stack_overflow(task);
+    }
+}
+
+static void _metal_sched_switch_in(struct _metal_sched_hart *hart,
+                                   struct metal_sched_task *task)
+{
+#ifdef __riscv_flen
+    unsigned long *frame = task->_sp;
+
+    /* Only reload the FP registers if another task has used them since */
+    if (task->_fp_valid && hart->fp_owner != task) {
+        __asm__ volatile("csrs mstatus, %0" :: "r" (METAL_MSTATUS_FS_INIT));
+        _metal_sched_fp_restore(task->_fp);
+        hart->fp_owner = task;
+        frame[_METAL_SCHED_FRAME_MSTATUS] &= ~_METAL_SCHED_MSTATUS_FS;
+        frame[_METAL_SCHED_FRAME_MSTATUS] |= METAL_MSTATUS_FS_CLEAN;
+    }
+#endif
+}
+
+void *_metal_sched_trap(void *frame)
+{
+    struct _metal_sched_hart *hart = &_metal_sched_harts[__metal_current_hartid()];
+    struct metal_sched_task *cur = hart->current;
+    struct metal_sched_task *next;
+    unsigned long mcause;
+    int request = _METAL_SCHED_REQ_NONE;
+
+    __asm__ volatile("csrr %0, mcause" : "=r" (mcause));
+
+    cur->_sp = frame;
+    hart->in_trap = 1;
+
+    if (mcause == _METAL_SCHED_ECALL_M && hart->request) {
+        /* A task asked to be switched out, resume it after the ecall */
+        ((unsigned long *)frame)[_METAL_SCHED_FRAME_MEPC] += 4;
+        request = hart->request;
+        hart->request = _METAL_SCHED_REQ_NONE;
+    } else {
+        __metal_exception_dispatch();
+    }
+
+    hart->in_trap = 0;
+
+    if (request == _METAL_SCHED_REQ_NONE && !hart->need_resched) {
+        return frame;
+    }
+    hart->need_resched = 0;
+
+    _metal_sched_lock(cur->_hartid);
+    next = _metal_sched_pick(hart, request);
+    _metal_sched_unlock(cur->_hartid);
+
+    if (next == cur) {
+        return frame;
+    }
+
+    _metal_sched_switch_out(hart, cur);
+    _metal_sched_switch_in(hart, next);
+    hart->current = next;
+
+    return next->_sp;
+}
+
+/* Trap into the scheduler from a task. Called with interrupts disabled. */
+static void _metal_sched_request(struct _metal_sched_hart *hart, int request)
+{
+    hart->request = request;
+    __asm__ volatile("ecall" ::: "memory");
+}
+
+static struct _metal_sched_hart *_metal_sched_task_hart(void)
+{
+    int hartid = __metal_current_hartid();
+    struct _metal_sched_hart *hart;
+
+    if (hartid >= __METAL_DT_MAX_HARTS) {
+        return NULL;
+    }
+    hart = &_metal_sched_harts[hartid];
+
+    /* Only tasks can switch themselves out */
+    if (!hart->started || hart->in_trap || hart->current == &hart->idle) {
+        return NULL;
+    }
+    return hart;
+}
+
+static void _metal_sched_slice(struct metal_swtimer *timer, void *arg)
+{
+    struct _metal_sched_hart *hart = arg;
+
+    hart->slice_expired = 1;
+    hart->need_resched = 1;
+    metal_swtimer_start(timer, metal_mtime_read() + METAL_SCHED_SLICE_TICKS);
+}
+
+static void _metal_sched_ipi(int id, void *arg)
+{
+    struct _metal_sched_hart *hart = arg;
+    int hartid = hart - _metal_sched_harts;
+
+    metal_cpu_software_clear_ipi(hart->cpu, hartid);
+    hart->need_resched = 1;
+}
+
+static void _metal_sched_wakeup(struct metal_swtimer *timer, void *arg)
+{
+    metal_sched_resume(arg);
+}
+
+void __attribute__((weak)) metal_sched_stack_overflow(struct metal_sched_task *task)
+{
+    metal_shutdown(400);
+}
+
+int metal_sched_task_init(struct metal_sched_task *task, metal_sched_fn fn,
+                          void *arg, int priority, void *stack,
+                          size_t stack_size, int hartid)
+{
+    struct _metal_sched_hart *hart;
+    unsigned long *frame;
+    unsigned long mstatus;
+    unsigned int *word;
+
+    if (hartid < 0 || hartid >= __METAL_DT_MAX_HARTS) {
+        return -1;
+    }
+    if (!fn || !stack || priority < 0 || priority >= METAL_SCHED_PRIORITIES ||
+        stack_size < 2 * _METAL_SCHED_FRAME_SIZE) {
+        return -1;
+    }
+    hart = &_metal_sched_harts[hartid];
+
+    task->_stack = (unsigned char *)(((uintptr_t)stack + 3) & ~(uintptr_t)3);
+    task->_stack_size = ((uintptr_t)stack + stack_size) & ~(uintptr_t)15;
+    task->_stack_size -= (uintptr_t)task->_stack;
+
+    /* Fill the stack so its watermark can be measured */
+    for (word = (unsigned int *)task->_stack;
+         (unsigned char *)word < task->_stack + task->_stack_size; word++) {
+        *word = (unsigned int)METAL_SCHED_STACK_FILL;
+    }
+
+    /* The first switch to the task "returns" from this trap frame into fn,
+     * which returns into metal_sched_exit() */
+    frame = (unsigned long *)(task->_stack + task->_stack_size - _METAL_SCHED_FRAME_SIZE);
+    for (size_t i = 0; i < _METAL_SCHED_FRAME_SIZE / sizeof(unsigned long); i++) {
+        frame[i] = 0;
+    }
+    frame[_METAL_SCHED_FRAME_MEPC] = (unsigned long)fn;
+    frame[_METAL_SCHED_FRAME_RA] = (unsigned long)metal_sched_exit;
+    frame[_METAL_SCHED_FRAME_A0] = (unsigned long)arg;
+    frame[_METAL_SCHED_FRAME_MSTATUS] = METAL_MSTATUS_MPP | METAL_MSTATUS_MPIE;
+#ifdef __riscv_flen
+    frame[_METAL_SCHED_FRAME_MSTATUS] |= METAL_MSTATUS_FS_INIT;
+    task->_fp_valid = 0;
+#endif
+
+    task->_sp = frame;
+    task->_prio = task->_base_prio = priority;
+    task->_hartid = hartid;
+    task->_locks_held = 0;
+    task->_resume_pending = 0;
+    task->_cancel_pending = 0;
+    metal_swtimer_init(&task->_timer, _metal_sched_wakeup, task);
+
+    mstatus = __metal_irq_save();
+    _metal_sched_lock(hartid);
+    _metal_sched_enqueue(hart, task, 0);
+    if (hart->started && priority > hart->current->_prio) {
+        _metal_sched_kick(hartid);
+    }
+    _metal_sched_unlock(hartid);
+    __metal_irq_restore(mstatus);
+
+    return 0;
+}
+
+void metal_sched_start(void)
+{
+    int hartid = __metal_current_hartid();
+    struct _metal_sched_hart *hart;
+    struct metal_interrupt *cpu_intr, *sw_intr;
+    int sw_id;
+
+    if (hartid >= __METAL_DT_MAX_HARTS) {
+        goto idle;
+    }
+    hart = &_metal_sched_harts[hartid];
+
+    hart->cpu = metal_cpu_get(hartid);
+    if (!hart->cpu) {
+        goto idle;
+    }
+    cpu_intr = metal_cpu_interrupt_controller(hart->cpu);
+    sw_intr = metal_cpu_software_interrupt_controller(hart->cpu);
+    if (!cpu_intr || !sw_intr) {
+        goto idle;
+    }
+    metal_interrupt_init(cpu_intr);
+    metal_interrupt_init(sw_intr);
+    sw_id = metal_cpu_software_get_interrupt_id(hart->cpu);
+
+    if (metal_swtimer_enable()) {
+        goto idle;
+    }
+    if (metal_interrupt_register_handler(sw_intr, sw_id, _metal_sched_ipi, hart) < 0) {
+        goto idle;
+    }
+    metal_interrupt_enable(sw_intr, sw_id);
+
+    hart->idle._prio = hart->idle._base_prio = -1;
+    hart->idle._hartid = hartid;
+    hart->idle._state = _METAL_SCHED_RUNNING;
+    hart->current = &hart->idle;
+
+    metal_swtimer_init(&hart->slice, _metal_sched_slice, hart);
+    metal_swtimer_start(&hart->slice, metal_mtime_read() + METAL_SCHED_SLICE_TICKS);
+
+    /* From here on every trap goes through the scheduler */
+    __metal_interrupt_global_disable();
+    __asm__ volatile("csrw mtvec, %0" :: "r" (_metal_sched_trap_entry));
+    hart->started = 1;
+    hart->need_resched = 1;
+    metal_cpu_software_set_ipi(hart->cpu, hartid);
+    metal_interrupt_enable(cpu_intr, 0);
+
+idle:
+    while (1) {
+        __asm__ volatile("wfi");
+    }
+}
+
+struct metal_sched_task *metal_sched_self(void)
+{
+    struct _metal_sched_hart *hart = _metal_sched_task_hart();
+
+    return hart ? hart->current : NULL;
+}
+
+void metal_sched_yield(void)
+{
+    struct _metal_sched_hart *hart = _metal_sched_task_hart();
+    unsigned long mstatus;
+
+    if (!hart) {
+        return;
+    }
+
+    mstatus = __metal_irq_save();
+    _metal_sched_request(hart, _METAL_SCHED_REQ_YIELD);
+    __metal_irq_restore(mstatus);
+}
+
+int metal_sched_sleep_until(unsigned long long deadline)
+{
+    struct _metal_sched_hart *hart = _metal_sched_task_hart();
+    unsigned long mstatus;
+
+    if (!hart) {
+        return -1;
+    }
+
+    mstatus = __metal_irq_save();
+    if (metal_swtimer_start(&hart->current->_timer, deadline)) {
+        __metal_irq_restore(mstatus);
+        return -1;
+    }
+    _metal_sched_request(hart, _METAL_SCHED_REQ_SUSPEND);
+    __metal_irq_restore(mstatus);
+
+    return 0;
+}
+
+void metal_sched_suspend(void)
+{
+    struct _metal_sched_hart *hart = _metal_sched_task_hart();
+    unsigned long mstatus;
+
+    if (!hart) {
+        return;
+    }
+
+    mstatus = __metal_irq_save();
+    _metal_sched_request(hart, _METAL_SCHED_REQ_SUSPEND);
+    __metal_irq_restore(mstatus);
+}
+
+int metal_sched_resume(struct metal_sched_task *task)
+{
+    struct _metal_sched_hart *hart;
+    unsigned long mstatus;
+
+    if (!task || task->_hartid < 0 || task->_hartid >= __METAL_DT_MAX_HARTS) {
+        return -1;
+    }
+    hart = &_metal_sched_harts[task->_hartid];
+
+    mstatus = __metal_irq_save();
+    _metal_sched_lock(task->_hartid);
+
+    if (task->_state == _METAL_SCHED_BLOCKED) {
+        if (task->_hartid == __metal_current_hartid()) {
+            metal_swtimer_cancel(&task->_timer);
+        } else {
+            /* If the timer fires first, it finds the task already ready */
+            task->_cancel_pending = 1;
+        }
+        _metal_sched_enqueue(hart, task, 0);
+        if (hart->started && task->_prio > hart->current->_prio) {
+            _metal_sched_kick(task->_hartid);
+        }
+    } else if (task->_state == _METAL_SCHED_RUNNING) {
+        /* It hasn't finished suspending yet */
+        task->_resume_pending = 1;
+    }
+
+    _metal_sched_unlock(task->_hartid);
+    __metal_irq_restore(mstatus);
+
+    return 0;
+}
+
+int metal_sched_set_priority(struct metal_sched_task *task, int priority)
+{
+    unsigned long mstatus;
+
+    if (!task || priority < 0 || priority >= METAL_SCHED_PRIORITIES) {
+        return -1;
+    }
+
+    mstatus = __metal_irq_save();
+    _metal_sched_lock(task->_hartid);
+
+    task->_base_prio = priority;
+    if (task->_locks_held == 0 || priority > task->_prio) {
+        _metal_sched_reprioritize(task, priority);
+    }
+
+    _metal_sched_unlock(task->_hartid);
+    __metal_irq_restore(mstatus);
+
+    return 0;
+}
+
+void metal_sched_exit(void)
+{
+    struct _metal_sched_hart *hart = _metal_sched_task_hart();
+
+    __metal_irq_save();
+    if (hart) {
+        _metal_sched_request(hart, _METAL_SCHED_REQ_EXIT);
+    }
+
+    /* Not reached from a task */
+    while (1) {
+        __asm__ volatile("wfi");
+    }
+}
+
+size_t metal_sched_stack_unused(struct metal_sched_task *task)
+{
+    unsigned int *word = (unsigned int *)task->_stack;
+    unsigned int *end = (unsigned int *)(task->_stack + task->_stack_size);
+
+    while (word < end && *word == (unsigned int)METAL_SCHED_STACK_FILL) {
+        word++;
+    }
+    return (unsigned char *)word - task->_stack;
+}
+
+#ifdef METAL_LOCK_PRIORITY_INHERIT
+
+/* Hooks called by metal_lock_take() and metal_lock_give() */
+
+static struct metal_sched_task *_metal_sched_lock_self(void)
+{
+    int hartid = __metal_current_hartid();
+    struct _metal_sched_hart *hart;
+
+    if (hartid >= __METAL_DT_MAX_HARTS) {
+        return NULL;
+    }
+    hart = &_metal_sched_harts[hartid];
+
+    /* Locks taken by interrupt handlers aren't owned by the interrupted task */
+    if (!hart->started || hart->in_trap || hart->current == &hart->idle) {
+        return NULL;
+    }
+    return hart->current;
+}
+
+void _metal_sched_lock_taken(struct metal_lock *lock)
+{
+    struct metal_sched_task *self = _metal_sched_lock_self();
+
+    lock->_holder = self;
+    if (self) {
+        self->_locks_held++;
+    }
+}
+
+void _metal_sched_lock_given(struct metal_sched_task *self)
+{
+    unsigned long mstatus;
+
+    if (!self) {
+        return;
+    }
+
+    mstatus = __metal_irq_save();
+    _metal_sched_lock(self->_hartid);
+    if (--self->_locks_held == 0) {
+        /* Give up any inherited priority, which lets whoever we were
+         * boosted for run */
+        _metal_sched_reprioritize(self, self->_base_prio);
+    }
+    _metal_sched_unlock(self->_hartid);
+    __metal_irq_restore(mstatus);
+}
+
+void _metal_sched_lock_contended(struct metal_lock *lock)
+{
+    struct metal_sched_task *self = _metal_sched_lock_self();
+    struct metal_sched_task *holder = __METAL_ACCESS_ONCE(&lock->_holder);
+    unsigned long mstatus;
+
+    if (!self || !holder || holder == self) {
+        return;
+    }
+
+    mstatus = __metal_irq_save();
+
+    _metal_sched_lock(holder->_hartid);
+    if (holder->_locks_held && holder->_prio < self->_prio) {
+        _metal_sched_reprioritize(holder, self->_prio);
+    }
+    _metal_sched_unlock(holder->_hartid);
+
+    /* Spinning would keep a holder on this hart from ever running */
+    if (holder->_hartid == self->_hartid) {
+        _metal_sched_request(&_metal_sched_harts[self->_hartid],
+                             _METAL_SCHED_REQ_YIELD);
+    }
+
+    __metal_irq_restore(mstatus);
+}
+
+#endif /* METAL_LOCK_PRIORITY_INHERIT */
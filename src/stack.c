@@ -0,0 +1,98 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <stdint.h>
+#include <metal/machine.h>
+#include <metal/pmp.h>
+#include <metal/shutdown.h>
+#include <metal/stack.h>
+
+extern char _sp;
+extern char __stack_size;
+/* Defined by METAL_STACK_SIZES and METAL_STACK_GUARD */
+extern const unsigned long __metal_stack_sizes[] __attribute__((weak));
+extern const unsigned long __metal_stack_guard_size __attribute__((weak));
+
+/* Matches the layout set up by crt0.S */
+int metal_stack_get_bounds(int hartid, uintptr_t *bottom, uintptr_t *top)
+{
+    uintptr_t stack_size = (uintptr_t)&__stack_size;
+    uintptr_t end = (uintptr_t)&_sp - stack_size;
+    uintptr_t size = stack_size;
+
+    if (hartid < 0 || hartid >= __METAL_DT_MAX_HARTS) {
+        return -1;
+    }
+
+    if (__metal_stack_sizes) {
+        for (int i = 0; i <= hartid; i++) {
+            size = __metal_stack_sizes[i] ? __metal_stack_sizes[i] : stack_size;
+            end += size;
+        }
+    } else {
+        end += (hartid + 1) * stack_size;
+    }
+
+    *bottom = end - size;
+    *top = end & ~(uintptr_t)15;
+    return 0;
+}
+
+/* Stop the program if the sizes given with METAL_STACK_SIZES don't fit in
+ * the space the linker script reserved, because the stacks would then overlap
+ * whatever lies above it */
+void __metal_stack_sizes_check(void) __attribute__((constructor));
+void __metal_stack_sizes_check(void)
+{
+    uintptr_t stack_size = (uintptr_t)&__stack_size;
+    uintptr_t total = 0;
+
+    if (!__metal_stack_sizes) {
+        return;
+    }
+
+    for (int i = 0; i < __METAL_DT_MAX_HARTS; i++) {
+        total += __metal_stack_sizes[i] ? __metal_stack_sizes[i] : stack_size;
+    }
+    if (total > __METAL_DT_MAX_HARTS * stack_size) {
+        metal_shutdown(600);
+    }
+}
+
+/* Called by crt0.S on every hart before main() */
+void __metal_stack_guard_init(void)
+{
+    struct metal_pmp *pmp = metal_pmp_get_device();
+    int hartid = __metal_current_hartid();
+    unsigned long size = &__metal_stack_guard_size ? __metal_stack_guard_size : 0;
+    uintptr_t bottom, top, guard;
+    int region;
+    struct metal_pmp_config config = {
+        .L = METAL_PMP_LOCKED,
+        .A = METAL_PMP_NAPOT,
+        .X = 0,
+        .W = 0,
+        .R = 0,
+    };
+
+    if (!pmp || !size || metal_stack_get_bounds(hartid, &bottom, &top)) {
+        return;
+    }
+
+    region = metal_pmp_num_regions(hartid) - 1;
+    if (region < 0) {
+        return;
+    }
+
+    /* The lowest naturally aligned block of the stack */
+    guard = (bottom + size - 1) & ~(uintptr_t)(size - 1);
+    if ((size & (size - 1)) || size < 8 || guard + size > top) {
+        /* A broken guard would give false confidence */
+        metal_shutdown(600);
+    }
+
+    if (metal_pmp_set_region(pmp, region, config,
+                             (guard | (size / 2 - 1)) >> 2) != 0) {
+        metal_shutdown(600);
+    }
+}
@@ -0,0 +1,337 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <limits.h>
+#include <metal/machine.h>
+#include <metal/cpu.h>
+#include <metal/interrupt.h>
+#include <metal/drivers/riscv_cpu.h>
+#include <metal/timer.h>
+#include <metal/swtimer.h>
+
+#define _METAL_SWTIMER_BITS 6
+#define _METAL_SWTIMER_SLOTS (1 << _METAL_SWTIMER_BITS)
+#define _METAL_SWTIMER_MASK (_METAL_SWTIMER_SLOTS - 1)
+#define _METAL_SWTIMER_SHIFT(level) ((level) * _METAL_SWTIMER_BITS)
+#define _METAL_SWTIMER_NONE ULLONG_MAX
+
+/* One wheel per hart. All times in here are in wheel ticks. */
+struct _metal_swtimer_wheel {
+    struct metal_cpu *cpu;
+    /* The next tick which hasn't been processed yet */
+    unsigned long long base;
+    /* The tick currently programmed into mtimecmp */
+    unsigned long long programmed;
+    /* One bit per non-empty slot */
+    unsigned long long occupied[METAL_SWTIMER_LEVELS];
+    struct metal_swtimer *slots[METAL_SWTIMER_LEVELS][_METAL_SWTIMER_SLOTS];
+};
+
+static struct _metal_swtimer_wheel _metal_swtimer_wheels[__METAL_DT_MAX_HARTS];
+
+extern __inline__ int metal_swtimer_pending(struct metal_swtimer *timer);
+
+static void _metal_swtimer_program(struct _metal_swtimer_wheel *wheel,
+                                   unsigned long long tick)
+{
+    wheel->programmed = tick;
+    if (tick == _METAL_SWTIMER_NONE) {
+        metal_cpu_set_mtimecmp(wheel->cpu, _METAL_SWTIMER_NONE);
+    } else {
+        metal_cpu_set_mtimecmp(wheel->cpu, tick << METAL_SWTIMER_SHIFT);
+    }
+}
+
+static void _metal_swtimer_link(struct _metal_swtimer_wheel *wheel,
+                                struct metal_swtimer *timer)
+{
+    /* Round up, so timers never expire early */
+    unsigned long long expires =
+        (timer->_expires + (1ULL << METAL_SWTIMER_SHIFT) - 1) >> METAL_SWTIMER_SHIFT;
+    unsigned long long delta;
+    struct metal_swtimer **slot;
+    int level, idx;
+
+    if (timer->_expires > ULLONG_MAX - (1ULL << METAL_SWTIMER_SHIFT)) {
+        expires = ULLONG_MAX >> METAL_SWTIMER_SHIFT;
+    }
+    if (expires < wheel->base) {
+        expires = wheel->base;
+    }
+    delta = expires - wheel->base;
+
+    for (level = 0; level < METAL_SWTIMER_LEVELS - 1; level++) {
+        if (delta < (1ULL << _METAL_SWTIMER_SHIFT(level + 1))) {
+            break;
+        }
+    }
+    if (delta >= (1ULL << _METAL_SWTIMER_SHIFT(METAL_SWTIMER_LEVELS))) {
+        /* Beyond the end of the wheel, park it in the furthest slot */
+        expires = wheel->base + (1ULL << _METAL_SWTIMER_SHIFT(METAL_SWTIMER_LEVELS)) - 1;
+    }
+
+    idx = (expires >> _METAL_SWTIMER_SHIFT(level)) & _METAL_SWTIMER_MASK;
+    slot = &wheel->slots[level][idx];
+
+    timer->_next = *slot;
+    if (timer->_next) {
+        timer->_next->_pprev = &timer->_next;
+    }
+    timer->_pprev = slot;
+    *slot = timer;
+    wheel->occupied[level] |= 1ULL << idx;
+}
+
+static void _metal_swtimer_unlink(struct _metal_swtimer_wheel *wheel,
+                                  struct metal_swtimer *timer)
+{
+    struct metal_swtimer **pprev = timer->_pprev;
+
+    *pprev = timer->_next;
+    if (timer->_next) {
+        timer->_next->_pprev = pprev;
+    }
+    timer->_next = 0;
+    timer->_pprev = 0;
+
+    /* If that emptied a slot, clear its bit. pprev only points into the slot
+     * array when the timer was first in its list. */
+    if (!*pprev &&
+        pprev >= &wheel->slots[0][0] &&
+        pprev < &wheel->slots[0][0] + (METAL_SWTIMER_LEVELS * _METAL_SWTIMER_SLOTS)) {
+        int n = pprev - &wheel->slots[0][0];
+        wheel->occupied[n / _METAL_SWTIMER_SLOTS] &= ~(1ULL << (n % _METAL_SWTIMER_SLOTS));
+    }
+}
+
+/* Take the whole list out of a slot */
+static struct metal_swtimer *_metal_swtimer_take(struct _metal_swtimer_wheel *wheel,
+                                                 int level, int idx)
+{
+    struct metal_swtimer *list = wheel->slots[level][idx];
+
+    wheel->slots[level][idx] = 0;
+    wheel->occupied[level] &= ~(1ULL << idx);
+    return list;
+}
+
+/* Find the first tick at or after base when the wheel has work to do: either
+ * a level 0 slot to run, or a higher level slot to move down. */
+static unsigned long long _metal_swtimer_next_tick(struct _metal_swtimer_wheel *wheel)
+{
+    unsigned long long next = _METAL_SWTIMER_NONE;
+
+    for (int level = 0; level < METAL_SWTIMER_LEVELS; level++) {
+        int shift = _METAL_SWTIMER_SHIFT(level);
+        unsigned long long pos = wheel->base >> shift;
+        int idx = pos & _METAL_SWTIMER_MASK;
+        unsigned long long rotated;
+        unsigned long long tick;
+        int offset;
+
+        if (!wheel->occupied[level]) {
+            continue;
+        }
+
+        rotated = (wheel->occupied[level] >> idx);
+        if (idx) {
+            rotated |= wheel->occupied[level] << (_METAL_SWTIMER_SLOTS - idx);
+        }
+
+        /* Unless base is on a boundary of this level, the current slot was
+         * already moved down and only holds timers for the next lap */
+        if (level > 0 && (wheel->base & ((1ULL << shift) - 1))) {
+            offset = (rotated & ~1ULL) ? __builtin_ctzll(rotated & ~1ULL)
+                                       : _METAL_SWTIMER_SLOTS;
+        } else {
+            offset = __builtin_ctzll(rotated);
+        }
+
+        tick = (pos + offset) << shift;
+        if (tick < next) {
+            next = tick;
+        }
+    }
+
+    return next;
+}
+
+static void _metal_swtimer_run(struct _metal_swtimer_wheel *wheel,
+                               unsigned long long now)
+{
+    while (1) {
+        unsigned long long next = _metal_swtimer_next_tick(wheel);
+        struct metal_swtimer *expired;
+
+        if (next > now) {
+            /* Nothing happens in between, so skip straight to now */
+            if (wheel->base <= now) {
+                wheel->base = now + 1;
+            }
+            break;
+        }
+        wheel->base = next;
+
+        /* Move the timers in any slots which start here down a level */
+        for (int level = 1; level < METAL_SWTIMER_LEVELS; level++) {
+            int shift = _METAL_SWTIMER_SHIFT(level);
+            struct metal_swtimer *list;
+
+            if (wheel->base & ((1ULL << shift) - 1)) {
+                break;
+            }
+            list = _metal_swtimer_take(wheel, level,
+                                       (wheel->base >> shift) & _METAL_SWTIMER_MASK);
+            while (list) {
+                struct metal_swtimer *timer = list;
+
+                list = timer->_next;
+                _metal_swtimer_link(wheel, timer);
+            }
+        }
+
+        expired = _metal_swtimer_take(wheel, 0, wheel->base & _METAL_SWTIMER_MASK);
+
+        /* Advance first, so callbacks which restart their timer in the past
+         * land in the next tick rather than a lap later */
+        wheel->base++;
+
+        while (expired) {
+            struct metal_swtimer *timer = expired;
+
+            expired = timer->_next;
+            timer->_next = 0;
+            timer->_pprev = 0;
+            timer->_callback(timer, timer->_arg);
+        }
+    }
+}
+
+static void _metal_swtimer_handler(int id, void *priv)
+{
+    struct _metal_swtimer_wheel *wheel = priv;
+    unsigned long long now = metal_mtime_read() >> METAL_SWTIMER_SHIFT;
+
+    _metal_swtimer_run(wheel, now);
+    _metal_swtimer_program(wheel, _metal_swtimer_next_tick(wheel));
+}
+
+int metal_swtimer_enable(void)
+{
+    int hartid = __metal_current_hartid();
+    struct _metal_swtimer_wheel *wheel;
+    struct metal_interrupt *tmr_intr;
+    int tmr_id;
+
+    if (hartid >= __METAL_DT_MAX_HARTS) {
+        return -1;
+    }
+    wheel = &_metal_swtimer_wheels[hartid];
+
+    wheel->cpu = metal_cpu_get(hartid);
+    if (!wheel->cpu) {
+        return -1;
+    }
+
+    tmr_intr = metal_cpu_timer_interrupt_controller(wheel->cpu);
+    if (!tmr_intr) {
+        return -1;
+    }
+    metal_interrupt_init(tmr_intr);
+    tmr_id = metal_cpu_timer_get_interrupt_id(wheel->cpu);
+
+    wheel->base = metal_mtime_read() >> METAL_SWTIMER_SHIFT;
+    _metal_swtimer_program(wheel, _METAL_SWTIMER_NONE);
+
+    if (metal_interrupt_register_handler(tmr_intr, tmr_id,
+                                         _metal_swtimer_handler, wheel) < 0) {
+        return -1;
+    }
+    return metal_interrupt_enable(tmr_intr, tmr_id);
+}
+
+void metal_swtimer_init(struct metal_swtimer *timer,
+                        metal_swtimer_callback callback, void *arg)
+{
+    timer->_next = 0;
+    timer->_pprev = 0;
+    timer->_expires = 0;
+    timer->_callback = callback;
+    timer->_arg = arg;
+    timer->_hartid = -1;
+}
+
+int metal_swtimer_start(struct metal_swtimer *timer, unsigned long long expires)
+{
+    int hartid = __metal_current_hartid();
+    struct _metal_swtimer_wheel *wheel;
+    unsigned long mstatus;
+    unsigned long long next;
+
+    if (hartid >= __METAL_DT_MAX_HARTS || !_metal_swtimer_wheels[hartid].cpu) {
+        return -1;
+    }
+    wheel = &_metal_swtimer_wheels[hartid];
+
+    mstatus = __metal_irq_save();
+
+    if (timer->_pprev) {
+        _metal_swtimer_unlink(wheel, timer);
+    }
+    timer->_expires = expires;
+    timer->_hartid = hartid;
+    _metal_swtimer_link(wheel, timer);
+
+    /* Only touch mtimecmp if this timer is now the first event */
+    next = _metal_swtimer_next_tick(wheel);
+    if (next < wheel->programmed) {
+        _metal_swtimer_program(wheel, next);
+    }
+
+    __metal_irq_restore(mstatus);
+
+    return 0;
+}
+
+int metal_swtimer_cancel(struct metal_swtimer *timer)
+{
+    unsigned long mstatus;
+    int pending = 0;
+
+    if (timer->_hartid < 0 || timer->_hartid >= __METAL_DT_MAX_HARTS) {
+        return 0;
+    }
+
+    mstatus = __metal_irq_save();
+
+    /* mtimecmp is left alone: an early interrupt finds nothing to do and
+     * programs the next event */
+    if (timer->_pprev) {
+        _metal_swtimer_unlink(&_metal_swtimer_wheels[timer->_hartid], timer);
+        pending = 1;
+    }
+
+    __metal_irq_restore(mstatus);
+
+    return pending;
+}
+
+unsigned long long metal_swtimer_next_event(void)
+{
+    int hartid = __metal_current_hartid();
+    unsigned long long next;
+    unsigned long mstatus;
+
+    if (hartid >= __METAL_DT_MAX_HARTS || !_metal_swtimer_wheels[hartid].cpu) {
+        return _METAL_SWTIMER_NONE;
+    }
+
+    mstatus = __metal_irq_save();
+    next = _metal_swtimer_next_tick(&_metal_swtimer_wheels[hartid]);
+    __metal_irq_restore(mstatus);
+
+    if (next == _METAL_SWTIMER_NONE) {
+        return next;
+    }
+    return next << METAL_SWTIMER_SHIFT;
+}
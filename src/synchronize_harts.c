@@ -14,6 +14,10 @@
  * _synchronize_harts() is called by crt0.S to cause harts > 0 to wait for
  * hart 0 to finish copying the datat section, zeroing the BSS, and running
  * the libc contstructors.
+ *
+ * This runs before the data section is valid, so it can't use a
+ * struct metal_barrier and signals through the MSIP bits instead. Once main()
+ * is running, use metal_barrier_wait() to synchronize harts.
  */
 __attribute__((section(".init")))
 void __metal_synchronize_harts() {
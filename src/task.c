@@ -0,0 +1,345 @@
+/* Copyright 2019 SiFive, Inc */
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#include <stdint.h>
+#include <metal/machine.h>
+#include <metal/drivers/riscv_cpu.h>
+#include <metal/idle.h>
+#include <metal/swtimer.h>
+#include <metal/task.h>
+
+#define _METAL_TASK_READY   0
+#define _METAL_TASK_RUNNING 1
+#define _METAL_TASK_BLOCKED 2
+#define _METAL_TASK_DONE    3
+
+/* Must match the frame saved by _metal_task_switch in task_switch.S */
+#ifdef __riscv_flen
+#define _METAL_TASK_FRAME_SIZE (16 * sizeof(unsigned long) + 12 * (__riscv_flen / 8))
+#else
+#define _METAL_TASK_FRAME_SIZE (16 * sizeof(unsigned long))
+#endif
+#define _METAL_TASK_FRAME_RA 0
+#define _METAL_TASK_FRAME_S0 1
+
+struct _metal_task_hart {
+    /* The running task, or NULL while metal_task_run() is idling */
+    struct metal_task *current;
+    /* The ready tasks, in the order they will run */
+    struct metal_task *head;
+    struct metal_task *tail;
+    /* The stack pointer of metal_task_run() while a task runs */
+    void *sched_sp;
+    int num_tasks;
+    /* Whether new tasks start with interrupts enabled */
+    unsigned long mie;
+};
+
+static struct _metal_task_hart _metal_task_harts[__METAL_DT_MAX_HARTS];
+
+void _metal_task_switch(void **save_sp, void *sp);
+void _metal_task_trampoline(void);
+void _metal_task_start(struct metal_task *task) __attribute__((noreturn));
+
+static struct _metal_task_hart *_metal_task_hart(void)
+{
+    int hartid = __metal_current_hartid();
+
+    if (hartid >= __METAL_DT_MAX_HARTS) {
+        return NULL;
+    }
+    return &_metal_task_harts[hartid];
+}
+
+static void _metal_task_enqueue(struct _metal_task_hart *hart,
+                                struct metal_task *task)
+{
+    task->_state = _METAL_TASK_READY;
+    task->_next = NULL;
+    if (hart->head) {
+        hart->tail->_next = task;
+    } else {
+        hart->head = task;
+    }
+    hart->tail = task;
+}
+
+static struct metal_task *_metal_task_dequeue(struct _metal_task_hart *hart)
+{
+    struct metal_task *task = hart->head;
+
+    if (task) {
+        hart->head = task->_next;
+        task->_next = NULL;
+        task->_state = _METAL_TASK_RUNNING;
+    }
+    return task;
+}
+
+/* Switch from the current task to the next ready one, or back to
+ * metal_task_run() if none is. Called with interrupts disabled, after the
+ * current task has been queued, blocked or ended. */
+static void _metal_task_schedule(struct _metal_task_hart *hart)
+{
+    struct metal_task *prev = hart->current;
+    struct metal_task *next = _metal_task_dequeue(hart);
+
+    hart->current = next;
+    if (next == prev) {
+        return;
+    }
+    _metal_task_switch(&prev->_sp, next ? next->_sp : hart->sched_sp);
+}
+
+/* Called with interrupts disabled */
+static void _metal_task_wake(struct metal_task *task)
+{
+    if (task->_state == _METAL_TASK_BLOCKED) {
+        _metal_task_enqueue(&_metal_task_harts[task->_hartid], task);
+    }
+}
+
+static void _metal_task_timeout(struct metal_swtimer *timer, void *arg)
+{
+    struct metal_task *task = arg;
+
+    if (task->_waiting) {
+        *task->_pprev = task->_next;
+        if (task->_next) {
+            task->_next->_pprev = task->_pprev;
+        }
+        task->_pprev = NULL;
+        task->_waiting = NULL;
+        task->_timed_out = 1;
+    }
+    _metal_task_wake(task);
+}
+
+void _metal_task_start(struct metal_task *task)
+{
+    __metal_irq_restore(_metal_task_harts[task->_hartid].mie);
+
+    task->_fn(task->_arg);
+    metal_task_exit();
+}
+
+int metal_task_init(struct metal_task *task, metal_task_fn fn, void *arg,
+                    void *stack, size_t stack_size)
+{
+    struct _metal_task_hart *hart = _metal_task_hart();
+    unsigned long *frame;
+    unsigned long mstatus;
+
+    if (!hart || !fn || !stack || stack_size < METAL_TASK_MIN_STACK) {
+        return -1;
+    }
+
+    /* The first switch to the task pops this frame and returns into the
+     * trampoline, which calls _metal_task_start(s0) */
+    frame = (unsigned long *)((((uintptr_t)stack + stack_size) & ~(uintptr_t)15)
+                              - _METAL_TASK_FRAME_SIZE);
+    for (size_t i = 0; i < _METAL_TASK_FRAME_SIZE / sizeof(unsigned long); i++) {
+        frame[i] = 0;
+    }
+    frame[_METAL_TASK_FRAME_RA] = (unsigned long)_metal_task_trampoline;
+    frame[_METAL_TASK_FRAME_S0] = (unsigned long)task;
+
+    task->_sp = frame;
+    task->_pprev = NULL;
+    task->_waiting = NULL;
+    task->_fn = fn;
+    task->_arg = arg;
+    task->_timed_out = 0;
+    task->_hartid = hart - _metal_task_harts;
+    metal_swtimer_init(&task->_timer, _metal_task_timeout, task);
+
+    mstatus = __metal_irq_save();
+    hart->num_tasks++;
+    _metal_task_enqueue(hart, task);
+    __metal_irq_restore(mstatus);
+
+    return 0;
+}
+
+int metal_task_run(void)
+{
+    struct _metal_task_hart *hart = _metal_task_hart();
+    struct metal_task *next;
+    unsigned long mstatus;
+
+    if (!hart || hart->current) {
+        return -1;
+    }
+
+    mstatus = __metal_irq_save();
+    hart->mie = mstatus & METAL_MSTATUS_MIE;
+
+    while (hart->num_tasks) {
+        next = _metal_task_dequeue(hart);
+        if (next) {
+            /* Returns when no task is ready */
+            hart->current = next;
+            _metal_task_switch(&hart->sched_sp, next->_sp);
+        } else {
+            /* Sleep with interrupts still disabled, then take the interrupt
+             * which woke us up, which may make a task ready */
+            metal_idle();
+            __metal_irq_restore(mstatus);
+            mstatus = __metal_irq_save();
+        }
+    }
+
+    __metal_irq_restore(mstatus);
+    return 0;
+}
+
+struct metal_task *metal_task_self(void)
+{
+    struct _metal_task_hart *hart = _metal_task_hart();
+
+    return hart ? hart->current : NULL;
+}
+
+void metal_task_yield(void)
+{
+    struct _metal_task_hart *hart = _metal_task_hart();
+    unsigned long mstatus;
+
+    if (!hart || !hart->current) {
+        return;
+    }
+
+    mstatus = __metal_irq_save();
+    if (hart->head) {
+        _metal_task_enqueue(hart, hart->current);
+        _metal_task_schedule(hart);
+    }
+    __metal_irq_restore(mstatus);
+}
+
+int metal_task_sleep_until(unsigned long long deadline)
+{
+    struct _metal_task_hart *hart = _metal_task_hart();
+    struct metal_task *task = hart ? hart->current : NULL;
+    unsigned long mstatus;
+
+    if (!task) {
+        return -1;
+    }
+
+    mstatus = __metal_irq_save();
+    if (metal_swtimer_start(&task->_timer, deadline)) {
+        __metal_irq_restore(mstatus);
+        return -1;
+    }
+    task->_state = _METAL_TASK_BLOCKED;
+    _metal_task_schedule(hart);
+    __metal_irq_restore(mstatus);
+
+    return 0;
+}
+
+void metal_task_exit(void)
+{
+    struct _metal_task_hart *hart = _metal_task_hart();
+
+    __metal_irq_save();
+    if (hart && hart->current) {
+        hart->current->_state = _METAL_TASK_DONE;
+        hart->num_tasks--;
+        _metal_task_schedule(hart);
+    }
+
+    /* Not reached from a task */
+    while (1) {
+        __asm__ volatile("wfi");
+    }
+}
+
+void metal_event_init(struct metal_event *event)
+{
+    event->_waiters = NULL;
+    event->_pending = 0;
+}
+
+static int _metal_event_wait(struct metal_event *event,
+                             unsigned long long deadline, int timed)
+{
+    struct _metal_task_hart *hart = _metal_task_hart();
+    struct metal_task *task = hart ? hart->current : NULL;
+    unsigned long mstatus;
+    int timed_out;
+
+    if (!task) {
+        return -1;
+    }
+
+    mstatus = __metal_irq_save();
+    if (event->_pending) {
+        event->_pending = 0;
+        __metal_irq_restore(mstatus);
+        return 0;
+    }
+    if (timed && metal_swtimer_start(&task->_timer, deadline)) {
+        __metal_irq_restore(mstatus);
+        return -1;
+    }
+
+    task->_next = event->_waiters;
+    if (task->_next) {
+        task->_next->_pprev = &task->_next;
+    }
+    task->_pprev = &event->_waiters;
+    event->_waiters = task;
+    task->_waiting = event;
+    task->_timed_out = 0;
+
+    task->_state = _METAL_TASK_BLOCKED;
+    _metal_task_schedule(hart);
+
+    timed_out = task->_timed_out;
+    __metal_irq_restore(mstatus);
+
+    return timed_out;
+}
+
+int metal_event_wait(struct metal_event *event)
+{
+    return _metal_event_wait(event, 0, 0);
+}
+
+int metal_event_wait_until(struct metal_event *event,
+                           unsigned long long deadline)
+{
+    return _metal_event_wait(event, deadline, 1);
+}
+
+void metal_event_signal(struct metal_event *event)
+{
+    struct metal_task *task, *next;
+    unsigned long mstatus;
+
+    mstatus = __metal_irq_save();
+
+    task = event->_waiters;
+    if (!task) {
+        event->_pending = 1;
+    }
+    event->_waiters = NULL;
+
+    while (task) {
+        next = task->_next;
+        task->_pprev = NULL;
+        task->_waiting = NULL;
+        metal_swtimer_cancel(&task->_timer);
+        _metal_task_wake(task);
+        task = next;
+    }
+
+    __metal_irq_restore(mstatus);
+}
+
+void metal_event_isr(int id, void *event)
+{
+    metal_event_signal(event);
+}
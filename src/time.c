@@ -6,16 +6,16 @@
 
 int metal_gettimeofday(struct timeval *tp, void *tzp)
 {
-    int rv;
-    unsigned long long mcc, timebase;
-    if (rv = metal_timer_get_cyclecount(0, &mcc)) {
-        return -1;
-    }
-    if (rv = metal_timer_get_timebase_frequency(0, &timebase)) {
+    unsigned long long rem;
+
+    if (__metal_mtime_check()) {
         return -1;
     }
-    tp->tv_sec = mcc / timebase;
-    tp->tv_usec = mcc % timebase * 1000000 / timebase;
+
+    /* mtime is shared by every hart and doesn't change rate with the core
+     * clock, unlike mcycle */
+    tp->tv_sec = metal_timer_ticks_to_sec(metal_mtime_read(), &rem);
+    tp->tv_usec = metal_timer_ticks_to_us(rem);
     return 0;
 }
 
@@ -1,6 +1,7 @@
 /* Copyright 2018 SiFive, Inc */
 /* SPDX-License-Identifier: Apache-2.0 */
 
+#include <limits.h>
 #ifndef __IAR_SYSTEMS_ICC__
 #include <sys/time.h>
 #include <sys/times.h>
@@ -8,6 +9,50 @@
 #include <metal/cpu.h>
 #include <metal/timer.h>
 #include <metal/machine.h>
+#include <metal/machine/platform.h>
+
+extern __inline__ unsigned long long metal_mtime_read(void);
+extern __inline__ int metal_timer_deadline_passed(unsigned long long deadline);
+
+unsigned long __metal_mtime_address = 0;
+/* The address of hart 0's mtimecmp, the others follow 8 bytes apart */
+static unsigned long __metal_mtimecmp_address = 0;
+
+static void __metal_mtime_resolve(void)
+{
+#if defined(__METAL_DT_RISCV_CLINT0_HANDLE)
+    unsigned long base = __metal_driver_sifive_clint0_control_base(__METAL_DT_RISCV_CLINT0_HANDLE);
+
+    __metal_mtimecmp_address = base + METAL_RISCV_CLINT0_MTIMECMP_BASE;
+    __metal_mtime_address = base + METAL_RISCV_CLINT0_MTIME;
+#elif defined(__METAL_DT_SIFIVE_CLIC0_HANDLE)
+    unsigned long base = __metal_driver_sifive_clic0_control_base(__METAL_DT_SIFIVE_CLIC0_HANDLE);
+
+    __metal_mtimecmp_address = base + METAL_SIFIVE_CLIC0_MTIMECMP_BASE;
+    __metal_mtime_address = base + METAL_SIFIVE_CLIC0_MTIME;
+#endif
+}
+
+static void __metal_mtime_init(void) __attribute__((constructor));
+static void __metal_mtime_init(void)
+{
+    __metal_mtime_resolve();
+}
+
+/* Used before the constructor has run, or when there is no CLINT or CLIC */
+unsigned long long __metal_mtime_read_slow(void)
+{
+    __metal_mtime_resolve();
+    if (__metal_mtime_address) {
+        return metal_mtime_read();
+    }
+
+#if defined(__METAL_DT_MAX_HARTS)
+    return metal_cpu_get_mtime(metal_cpu_get(metal_cpu_get_current_hartid()));
+#else
+    return 0;
+#endif
+}
 
 #if defined(__METAL_DT_MAX_HARTS)
 /* This implementation serves as a small shim that interfaces with the first
@@ -34,7 +79,7 @@ int metal_timer_get_timebase_frequency(int hartid, unsigned long long *timebase)
     return -1;
 }
 
-int metal_timer_get_machine_time(int hartid)
+unsigned long long metal_timer_get_machine_time(int hartid)
 {
     struct metal_cpu *cpu = metal_cpu_get(hartid);
        
@@ -54,6 +99,48 @@ int metal_timer_set_machine_time(int hartid, unsigned long long time)
     return -1;
 }
 
+int metal_timer_set_compare(unsigned long long time)
+{
+    int hartid;
+    unsigned long mtimecmp;
+
+    if (!__metal_mtimecmp_address) {
+        __metal_mtime_resolve();
+    }
+    hartid = __metal_current_hartid();
+
+    if (!__metal_mtimecmp_address) {
+        return metal_timer_set_machine_time(hartid, time);
+    }
+    mtimecmp = __metal_mtimecmp_address + (8 * hartid);
+
+#if __riscv_xlen == 32
+    /* mtimecmp is not latched for multiword writes, so park the high word at
+     * its maximum while the low word changes to avoid a spurious interrupt */
+    __METAL_ACCESS_ONCE((__metal_io_u32 *)(mtimecmp + 4)) = 0xFFFFFFFF;
+    __METAL_ACCESS_ONCE((__metal_io_u32 *)mtimecmp) = (__metal_io_u32)time;
+    __METAL_ACCESS_ONCE((__metal_io_u32 *)(mtimecmp + 4)) = (__metal_io_u32)(time >> 32);
+#else
+    __METAL_ACCESS_ONCE((__metal_io_u64 *)mtimecmp) = time;
+#endif
+    return 0;
+}
+
+int metal_timer_set_timeout(unsigned long long ticks, unsigned long long *deadline)
+{
+    unsigned long long now = metal_mtime_read();
+    unsigned long long time = now + ticks;
+
+    /* Saturate rather than wrap around into the past */
+    if (time < now) {
+        time = ~0ULL;
+    }
+    if (deadline) {
+        *deadline = time;
+    }
+    return metal_timer_set_compare(time);
+}
+
 #else
 
 /* This implementation of gettimeofday doesn't actually do anything, it's just there to
@@ -66,6 +153,11 @@ int nop_timebase(unsigned long long *t) { return -1; }
 int nop_tick(int second) __attribute__((section(".text.metal.nop.tick")));
 int nop_tick(int second) { return -1; }
 
+unsigned long long metal_timer_get_machine_time(int hartid) { return 0; }
+int metal_timer_set_machine_time(int hartid, unsigned long long time) { return -1; }
+int metal_timer_set_compare(unsigned long long time) { return -1; }
+int metal_timer_set_timeout(unsigned long long ticks, unsigned long long *deadline) { return -1; }
+
 #ifdef __IAR_SYSTEMS_ICC__
 int metal_timer_get_cyclecount(int hartid, unsigned long long *c);
 #pragma weak metal_timer_get_cyclecount = nop_cyclecount
@@ -90,3 +182,180 @@ int metal_timer_set_tick(int second) __attribute__((weak, alias("nop_tick")))
 
 #endif
 
+static struct {
+    struct __metal_timer_scale to_ns;
+    struct __metal_timer_scale to_us;
+    struct __metal_timer_scale to_sec;
+    struct __metal_timer_scale from_ns;
+    unsigned long long timebase;
+    int valid;
+} __metal_timer_scales;
+
+/* The high bits of a 64x64 bit product */
+unsigned long long __metal_timer_mul_shr(unsigned long long a,
+                                         unsigned long long b,
+                                         unsigned int shift)
+{
+#ifdef __SIZEOF_INT128__
+    return (unsigned long long)(((unsigned __int128)a * b) >> shift);
+#else
+    unsigned long long a_lo = (unsigned int)a, a_hi = a >> 32;
+    unsigned long long b_lo = (unsigned int)b, b_hi = b >> 32;
+    unsigned long long lo = a_lo * b_lo;
+    unsigned long long mid1 = a_hi * b_lo;
+    unsigned long long mid2 = a_lo * b_hi;
+    unsigned long long mid = (lo >> 32) + (unsigned int)mid1 + (unsigned int)mid2;
+    unsigned long long res_lo = (mid << 32) | (unsigned int)lo;
+    unsigned long long res_hi = (a_hi * b_hi) + (mid1 >> 32) + (mid2 >> 32) + (mid >> 32);
+
+    if (shift == 0) {
+        return res_lo;
+    }
+    if (shift >= 64) {
+        return res_hi >> (shift - 64);
+    }
+    return (res_hi << (64 - shift)) | (res_lo >> shift);
+#endif
+}
+
+/* Find the largest shift which keeps mult below 2^62, by long division one
+ * bit at a time. Only runs once, so the divide here doesn't matter. */
+void __metal_timer_scale_init(struct __metal_timer_scale *scale,
+                              unsigned long long num,
+                              unsigned long long den)
+{
+    unsigned long long mult = num / den;
+    unsigned long long rem = num % den;
+    unsigned int shift = 0;
+
+    while (shift < 127 && mult < (1ULL << 61)) {
+        mult <<= 1;
+        rem <<= 1;
+        if (rem >= den) {
+            mult |= 1;
+            rem -= den;
+        }
+        shift++;
+    }
+
+    scale->mult = mult;
+    scale->shift = shift;
+}
+
+static int __metal_timer_scales_init(void)
+{
+    unsigned long long timebase;
+
+    if (__metal_timer_scales.valid) {
+        return 0;
+    }
+    if (metal_timer_get_timebase_frequency(0, &timebase) || timebase == 0) {
+        return -1;
+    }
+
+    __metal_timer_scale_init(&__metal_timer_scales.to_ns, 1000000000ULL, timebase);
+    __metal_timer_scale_init(&__metal_timer_scales.to_us, 1000000ULL, timebase);
+    __metal_timer_scale_init(&__metal_timer_scales.to_sec, 1ULL, timebase);
+    __metal_timer_scale_init(&__metal_timer_scales.from_ns, timebase, 1000000000ULL);
+    __metal_timer_scales.timebase = timebase;
+
+    /* Another hart may be reading the scales as soon as they're valid */
+    __asm__ volatile("fence w,w" ::: "memory");
+    __metal_timer_scales.valid = 1;
+
+    return 0;
+}
+
+int __metal_mtime_check(void)
+{
+    if (__metal_timer_scales_init()) {
+        return -1;
+    }
+#if !defined(METAL_MTIME_USE_RDTIME)
+    if (!__metal_mtime_address) {
+        __metal_mtime_resolve();
+    }
+    if (!__metal_mtime_address) {
+        /* metal_mtime_read() falls back to the CPU driver */
+#if defined(__METAL_DT_MAX_HARTS)
+        if (!metal_cpu_get(metal_cpu_get_current_hartid())) {
+            return -1;
+        }
+#else
+        return -1;
+#endif
+    }
+#endif
+    return 0;
+}
+
+unsigned long long metal_timer_ticks_to_ns(unsigned long long ticks)
+{
+    if (__metal_timer_scales_init()) {
+        return 0;
+    }
+    return __metal_timer_mul_shr(ticks, __metal_timer_scales.to_ns.mult,
+                                 __metal_timer_scales.to_ns.shift);
+}
+
+unsigned long long metal_timer_ticks_to_us(unsigned long long ticks)
+{
+    if (__metal_timer_scales_init()) {
+        return 0;
+    }
+    return __metal_timer_mul_shr(ticks, __metal_timer_scales.to_us.mult,
+                                 __metal_timer_scales.to_us.shift);
+}
+
+unsigned long long metal_timer_ticks_to_sec(unsigned long long ticks,
+                                            unsigned long long *remainder)
+{
+    unsigned long long sec, rem;
+
+    if (__metal_timer_scales_init()) {
+        *remainder = 0;
+        return 0;
+    }
+
+    /* The multiplier is rounded down, so the estimate is never too big and
+     * at most a second short */
+    sec = __metal_timer_mul_shr(ticks, __metal_timer_scales.to_sec.mult,
+                                __metal_timer_scales.to_sec.shift);
+    rem = ticks - (sec * __metal_timer_scales.timebase);
+    while (rem >= __metal_timer_scales.timebase) {
+        rem -= __metal_timer_scales.timebase;
+        sec++;
+    }
+
+    *remainder = rem;
+    return sec;
+}
+
+unsigned long long metal_timer_ns_to_ticks(unsigned long long ns)
+{
+    unsigned long long timebase, sec, rem, ticks, frac;
+
+    if (__metal_timer_scales_init()) {
+        return 0;
+    }
+    timebase = __metal_timer_scales.timebase;
+
+    /* Exactly ceil(ns * timebase / 10^9), put together from whole seconds
+     * and the nanoseconds left over so that no product overflows. This only
+     * sets up waits, so unlike the other conversions it can afford to divide,
+     * and only ever by a constant. */
+    sec = ns / 1000000000ULL;
+    rem = ns % 1000000000ULL;
+    frac = rem * (timebase / 1000000000ULL) +
+           (rem * (timebase % 1000000000ULL) + 999999999ULL) / 1000000000ULL;
+
+    /* Saturate rather than wrap when the ticks don't fit */
+    if (__metal_timer_mul_shr(sec, timebase, 64)) {
+        return ULLONG_MAX;
+    }
+    ticks = sec * timebase;
+    if (ticks > ULLONG_MAX - frac) {
+        return ULLONG_MAX;
+    }
+    return ticks + frac;
+}